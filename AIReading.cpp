@@ -3,6 +3,9 @@
 #include "Config.h"
 #include "HTTPClient.h"
 #include "JSONParser.h"
+#include "PayloadTemplate.h"
+#include "ReadingCache.h"
+#include "TLSContext.h"
 
 #include <iostream>
 #include <stdlib.h>
@@ -10,8 +13,12 @@
 
 
 BString
-AIReading::GetReading(const std::vector<CardInfo>& cards, SpreadType spreadType)
+AIReading::GetReading(const std::vector<CardInfo>& cards, SpreadType spreadType,
+	const DeltaCallback& onDelta, CancellationToken* cancelToken, bool* succeeded)
 {
+	if (succeeded != NULL)
+		*succeeded = false;
+
 	if (!Config::IsAPIKeySet()) {
 		BString message
 			= "DeepSeek API key not set. Please set the DEEPSEEK_API_KEY environment variable.\n\n";
@@ -56,8 +63,29 @@ AIReading::GetReading(const std::vector<CardInfo>& cards, SpreadType spreadType)
 		   "interactions. "
 		   "Keep the response to 5-7 sentences. Do not use markdown or any special formatting.";
 
-	BString jsonPayload
-		= JSONParser::BuildPayload(prompt, Config::kAPIMaxTokens, Config::kAPITemperature);
+	BString endpoint = Config::GetAPIEndpoint();
+
+	// The cache is keyed by the endpoint and the non-streaming payload, so that
+	// switching streaming on or off does not throw cached readings away while
+	// readings from a stand-in server never show up for the real one
+	static const PayloadTemplate sPayload(Config::kAPIMaxTokens, Config::kAPITemperature, false);
+	static const PayloadTemplate sStreamPayload(
+		Config::kAPIMaxTokens, Config::kAPITemperature, true);
+	BString cachePayload = sPayload.Render(prompt);
+	BString cacheKey = endpoint;
+	cacheKey << "\n" << cachePayload;
+	bool useCache = !Config::GetBypassReadingCache();
+	if (useCache) {
+		BString cached;
+		if (ReadingCache::Default().Lookup(cacheKey, cached)) {
+			if (succeeded != NULL)
+				*succeeded = true;
+			return cached;
+		}
+	}
+
+	bool stream = static_cast<bool>(onDelta);
+	BString jsonPayload = stream ? sStreamPayload.Render(prompt) : cachePayload;
 
 
 	BString authHeader = "Bearer ";
@@ -65,9 +93,112 @@ AIReading::GetReading(const std::vector<CardInfo>& cards, SpreadType spreadType)
 
 
 	HTTPClient httpClient;
-	BString response
-		= httpClient.Post("https://api.deepseek.com/v1/chat/completions", jsonPayload, authHeader);
+	if (!stream) {
+		// The response is parsed while it is read, by a reader that each
+		// worker thread keeps for all of its readings
+		static thread_local CompletionReader sReader;
+		sReader.Reset();
+		HTTPResult result = httpClient.Post(endpoint, jsonPayload, authHeader,
+			[](const char* data, size_t length) { sReader.Feed(data, length); }, cancelToken);
+		if (result.status != HTTPResult::kCompleted)
+			return DescribeFailure(result);
+
+		sReader.Finish();
+		bool parsed;
+		BString reading = sReader.Reading(&parsed);
+		if (parsed && useCache)
+			ReadingCache::Default().Store(cacheKey, reading);
+		if (succeeded != NULL)
+			*succeeded = parsed;
+		return reading;
+	}
+
+	BString reading;
+	BString error;
+	bool truncated = false;
+	HTTPResult result = httpClient.PostStreaming(endpoint, jsonPayload, authHeader,
+		[&](const BString& eventData) {
+			if (eventData == "[DONE]" || !error.IsEmpty())
+				return;
+
+			bool failed = false;
+			BString delta = JSONParser::ParseStreamEvent(eventData, &truncated, &failed);
+			if (failed) {
+				error = delta;
+				return;
+			}
+
+			if (!delta.IsEmpty()) {
+				reading += delta;
+				onDelta(delta);
+			}
+		},
+		cancelToken);
+
+	if (result.status != HTTPResult::kCompleted) {
+		if (reading.IsEmpty())
+			return DescribeFailure(result);
+
+		// Keep what already arrived and say why the rest is missing
+		reading << " [" << DescribeFailure(result) << "]";
+		return reading;
+	}
+
+	// Errors and non-streaming replies come back as a regular response body
+	if (!result.body.IsEmpty())
+		return JSONParser::ParseAPIResponse(result.body);
+
+	if (!error.IsEmpty())
+		return error;
 
+	if (reading.IsEmpty())
+		return BString("Error: Unexpected API response format.");
 
-	return JSONParser::ParseAPIResponse(response);
+	if (truncated)
+		reading += " [Response truncated due to token limit]";
+
+	if (useCache)
+		ReadingCache::Default().Store(cacheKey, reading);
+	if (succeeded != NULL)
+		*succeeded = true;
+
+	return reading;
+}
+
+
+BString
+AIReading::NetworkReport()
+{
+	BString report;
+	report << "TLS handshakes: " << TLSContext::FullHandshakeCount() << " full, "
+		<< TLSContext::ResumedHandshakeCount() << " resumed\n";
+
+	report << "Requests cancelled: " << HTTPClient::CancelCount() << "\n";
+	report << "Requests timed out:\n";
+	for (int32 phase = 0; phase < kPhaseCount; phase++) {
+		RequestPhase requestPhase = static_cast<RequestPhase>(phase);
+		report << "  while " << RequestDeadline::PhaseName(requestPhase) << ": "
+			<< HTTPClient::TimeoutCount(requestPhase) << "\n";
+	}
+	return report;
+}
+
+
+BString
+AIReading::DescribeFailure(const HTTPResult& result)
+{
+	BString message;
+	switch (result.status) {
+		case HTTPResult::kTimedOut:
+			message << "Error: The reading request timed out while "
+					<< RequestDeadline::PhaseName(result.phase) << ".";
+			break;
+		case HTTPResult::kCancelled:
+			message = "The reading request was cancelled.";
+			break;
+		default:
+			message = result.error;
+			break;
+	}
+	return message;
 }
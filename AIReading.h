@@ -2,11 +2,30 @@
 
 #include "CardPresenter.h"
 #include <String.h>
+#include <functional>
 #include <vector>
 
+class CancellationToken;
 struct CardInfo;
+struct HTTPResult;
 
 class AIReading {
 public:
-	static BString GetReading(const std::vector<CardInfo>& cards, SpreadType spreadType);
+	// Called with each piece of the reading as it is generated.
+	typedef std::function<void(const BString& delta)> DeltaCallback;
+
+	// When onDelta is set the reading is streamed and onDelta sees the text as
+	// it arrives; the complete reading is returned either way. Cancelling
+	// cancelToken aborts the request wherever it is. succeeded, if given, is
+	// set to whether the text is a reading rather than an error message.
+	static BString GetReading(const std::vector<CardInfo>& cards, SpreadType spreadType,
+		const DeltaCallback& onDelta = DeltaCallback(), CancellationToken* cancelToken = NULL,
+		bool* succeeded = NULL);
+
+	// What the connections to the API have done so far, as printed by the
+	// Print Network Report menu item
+	static BString NetworkReport();
+
+private:
+	static BString DescribeFailure(const HTTPResult& result);
 };
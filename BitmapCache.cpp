@@ -0,0 +1,531 @@
+#include "BitmapCache.h"
+#include "CardPack.h"
+#include "CardPreviewFormat.h"
+#include "Config.h"
+#include "DiskBitmapCache.h"
+#include "ImageScaler.h"
+
+#include <Application.h>
+#include <Bitmap.h>
+#include <DataIO.h>
+#include <Entry.h>
+#include <File.h>
+#include <Resources.h>
+#include <Roster.h>
+#include <TranslationUtils.h>
+
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <webp/decode.h>
+
+
+// BResources does no locking of its own, and the application's resources
+// are shared with every thread that decodes cards.
+static std::mutex sResourceLock;
+// Compressed bytes of each card read for decodes in progress, and the size of
+// the previews resource once loaded; guarded by sResourceLock
+static std::map<int32, size_t> sCompressedHeld;
+static size_t sPreviewBytes = 0;
+
+
+static BString
+FormatBytes(size_t bytes)
+{
+	char buffer[32];
+	if (bytes >= 1024 * 1024)
+		snprintf(buffer, sizeof(buffer), "%.1f MB", bytes / (1024.0 * 1024.0));
+	else if (bytes >= 1024)
+		snprintf(buffer, sizeof(buffer), "%.1f KB", bytes / 1024.0);
+	else
+		snprintf(buffer, sizeof(buffer), "%zu B", bytes);
+	return BString(buffer);
+}
+
+
+BitmapCache&
+BitmapCache::Default()
+{
+	static BitmapCache sCache;
+	return sCache;
+}
+
+
+BitmapCache::BitmapCache()
+	:
+	fBudget(Config::kBitmapCacheMaxBytes),
+	fUsage(0),
+	fHits(0),
+	fMisses(0),
+	fEvictions(0)
+{
+}
+
+
+BitmapCache::~BitmapCache()
+{
+}
+
+
+std::shared_ptr<BBitmap>
+BitmapCache::Get(int32 resourceID)
+{
+	Key key = {resourceID, 0, 0};
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		std::shared_ptr<BBitmap> bitmap = LookupLocked(key);
+		if (bitmap)
+			return bitmap;
+	}
+
+	// Decode without holding the lock so that hits on other cards do not
+	// wait for it
+	fMisses++;
+	std::shared_ptr<BBitmap> bitmap(Decode(resourceID));
+	if (!bitmap)
+		return bitmap;
+
+	std::lock_guard<std::mutex> lock(fLock);
+	return InsertLocked(key, bitmap);
+}
+
+
+std::shared_ptr<BBitmap>
+BitmapCache::Lookup(int32 resourceID)
+{
+	return Lookup(resourceID, 0, 0);
+}
+
+
+std::shared_ptr<BBitmap>
+BitmapCache::Lookup(int32 resourceID, int32 boxWidth, int32 boxHeight)
+{
+	Key key = {resourceID, boxWidth, boxHeight};
+	std::lock_guard<std::mutex> lock(fLock);
+	return LookupLocked(key);
+}
+
+
+bool
+BitmapCache::Contains(int32 resourceID, int32 boxWidth, int32 boxHeight) const
+{
+	Key key = {resourceID, boxWidth, boxHeight};
+	std::lock_guard<std::mutex> lock(fLock);
+	return fIndex.find(key) != fIndex.end();
+}
+
+
+void
+BitmapCache::Insert(int32 resourceID, int32 boxWidth, int32 boxHeight,
+	const std::shared_ptr<BBitmap>& bitmap, bool keepOnDisk)
+{
+	if (!bitmap)
+		return;
+
+	Key key = {resourceID, boxWidth, boxHeight};
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		InsertLocked(key, bitmap);
+	}
+
+	if (keepOnDisk && boxWidth > 0 && boxHeight > 0)
+		DiskBitmapCache::Default().Store(resourceID, boxWidth, boxHeight, bitmap);
+}
+
+
+std::shared_ptr<BBitmap>
+BitmapCache::LookupStored(int32 resourceID, int32 boxWidth, int32 boxHeight)
+{
+	if (boxWidth <= 0 || boxHeight <= 0)
+		return std::shared_ptr<BBitmap>();
+
+	return DiskBitmapCache::Default().Lookup(resourceID, boxWidth, boxHeight);
+}
+
+
+BString
+BitmapCache::MemoryReport() const
+{
+	struct CardMemory {
+		size_t compressed;
+		size_t compressedHeld;
+		size_t decoded;
+		int32 copies;
+	};
+
+	std::map<int32, CardMemory> cards;
+	size_t previewBytes;
+	BResources* appResources = BApplication::AppResources();
+	{
+		std::lock_guard<std::mutex> lock(sResourceLock);
+		int32 id;
+		const char* name;
+		size_t size;
+		for (int32 i = 0; appResources != NULL
+			&& appResources->GetResourceInfo('BBMP', i, &id, &name, &size); i++) {
+			cards[id].compressed = size;
+		}
+		for (auto it = sCompressedHeld.begin(); it != sCompressedHeld.end(); ++it)
+			cards[it->first].compressedHeld = it->second;
+		previewBytes = sPreviewBytes;
+	}
+
+	size_t budget;
+	size_t usage;
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		for (auto it = fRecent.begin(); it != fRecent.end(); ++it) {
+			CardMemory& card = cards[it->key.resourceID];
+			card.decoded += it->size;
+			card.copies++;
+		}
+		budget = fBudget;
+		usage = fUsage;
+	}
+
+	BString report;
+	report << "Card images: " << FormatBytes(usage) << " decoded of a "
+		<< FormatBytes(budget) << " budget, " << Hits() << " hits, " << Misses()
+		<< " misses, " << Evictions() << " evictions\n";
+
+	char line[128];
+	snprintf(line, sizeof(line), "%6s %12s %12s %12s %7s\n", "card", "compressed", "held",
+		"decoded", "copies");
+	report << line;
+
+	CardMemory total = {};
+	for (auto it = cards.begin(); it != cards.end(); ++it) {
+		const CardMemory& card = it->second;
+		snprintf(line, sizeof(line), "%6" B_PRId32 " %12s %12s %12s %7" B_PRId32 "\n",
+			it->first, FormatBytes(card.compressed).String(),
+			FormatBytes(card.compressedHeld).String(), FormatBytes(card.decoded).String(),
+			card.copies);
+		report << line;
+
+		total.compressed += card.compressed;
+		total.compressedHeld += card.compressedHeld;
+		total.decoded += card.decoded;
+		total.copies += card.copies;
+	}
+
+	snprintf(line, sizeof(line), "%6s %12s %12s %12s %7" B_PRId32 "\n", "total",
+		FormatBytes(total.compressed).String(), FormatBytes(total.compressedHeld).String(),
+		FormatBytes(total.decoded).String(), total.copies);
+	report << line;
+	report << "Card previews: " << FormatBytes(previewBytes) << "\n";
+	return report;
+}
+
+
+void
+BitmapCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(fLock);
+	fRecent.clear();
+	fIndex.clear();
+	fUsage = 0;
+}
+
+
+BBitmap*
+BitmapCache::Decode(int32 resourceID)
+{
+	// Pixels from the card pack are used in place
+	BBitmap* bitmap = CardPack::Default().Bitmap(resourceID);
+	if (bitmap != NULL)
+		return bitmap;
+
+	return DecodeResource(resourceID, 0, 0);
+}
+
+
+BBitmap*
+BitmapCache::Decode(int32 resourceID, int32 boxWidth, int32 boxHeight)
+{
+	BBitmap* bitmap = CardPack::Default().Bitmap(resourceID, boxWidth, boxHeight);
+	if (bitmap != NULL)
+		return bitmap;
+
+	return DecodeResource(resourceID, boxWidth, boxHeight);
+}
+
+
+BBitmap*
+BitmapCache::DecodeResource(int32 resourceID, int32 boxWidth, int32 boxHeight)
+{
+	// The shared AppResources() object keeps every item it reads for as long
+	// as the application runs, ReadResource() included. Each card is read
+	// through resources of its own instead, which free the compressed image
+	// together with themselves once it is decoded.
+	static entry_ref sAppRef;
+	static bool sHaveAppRef = []() {
+		app_info info;
+		if (be_app == NULL || be_app->GetAppInfo(&info) != B_OK)
+			return false;
+		sAppRef = info.ref;
+		return true;
+	}();
+	if (!sHaveAppRef)
+		return NULL;
+
+	BFile file(&sAppRef, B_READ_ONLY);
+	BResources resources;
+	if (file.InitCheck() != B_OK || resources.SetTo(&file) != B_OK)
+		return NULL;
+
+	size_t size;
+	const void* data = resources.LoadResource('BBMP', resourceID, &size);
+	if (data == NULL)
+		return NULL;
+
+	{
+		std::lock_guard<std::mutex> lock(sResourceLock);
+		sCompressedHeld[resourceID] += size;
+	}
+
+	BBitmap* bitmap = DecodeWebP(data, size, boxWidth, boxHeight);
+	if (bitmap == NULL) {
+		// Anything libwebp cannot read goes through the Translation Kit
+		BMemoryIO stream(data, size);
+		bitmap = BTranslationUtils::GetBitmap(&stream);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sResourceLock);
+		auto it = sCompressedHeld.find(resourceID);
+		it->second -= size;
+		if (it->second == 0)
+			sCompressedHeld.erase(it);
+	}
+	return bitmap;
+}
+
+
+BBitmap*
+BitmapCache::DecodeWebP(const void* data, size_t size, int32 boxWidth, int32 boxHeight)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	WebPDecoderConfig config;
+	if (!WebPInitDecoderConfig(&config)
+		|| WebPGetFeatures(bytes, size, &config.input) != VP8_STATUS_OK) {
+		return NULL;
+	}
+
+	// Let libwebp scale while decoding instead of producing the full image
+	int32 width = config.input.width;
+	int32 height = config.input.height;
+	if (boxWidth > 0 && boxHeight > 0) {
+		int32 fitWidth;
+		int32 fitHeight;
+		ImageScaler::FitSize(width, height, boxWidth, boxHeight, fitWidth, fitHeight);
+		if (fitWidth < width) {
+			config.options.use_scaling = 1;
+			config.options.scaled_width = fitWidth;
+			config.options.scaled_height = fitHeight;
+			width = fitWidth;
+			height = fitHeight;
+		}
+	}
+	config.options.use_threads = 1;
+
+	BBitmap* bitmap = new BBitmap(BRect(0, 0, width - 1, height - 1), B_RGBA32);
+	if (bitmap->InitCheck() != B_OK) {
+		delete bitmap;
+		return NULL;
+	}
+
+	// Decode straight into the bitmap; B_RGBA32 is B, G, R, A in memory
+	config.output.colorspace = MODE_BGRA;
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = static_cast<uint8_t*>(bitmap->Bits());
+	config.output.u.RGBA.stride = bitmap->BytesPerRow();
+	config.output.u.RGBA.size = bitmap->BitsLength();
+
+	VP8StatusCode status = WebPDecode(bytes, size, &config);
+	WebPFreeDecBuffer(&config.output);
+	if (status != VP8_STATUS_OK) {
+		delete bitmap;
+		return NULL;
+	}
+	return bitmap;
+}
+
+
+std::shared_ptr<BBitmap>
+BitmapCache::Preview(int32 resourceID)
+{
+	struct Source {
+		int32 width;
+		int32 height;
+		const uint8* pixels;
+	};
+
+	// The previews resource stays loaded for as long as the application
+	// runs, so the index can point into it
+	static const std::map<int32, Source> sSources = []() {
+		std::map<int32, Source> sources;
+		BResources* appResources = BApplication::AppResources();
+		if (appResources == NULL)
+			return sources;
+
+		size_t size;
+		const void* data;
+		{
+			std::lock_guard<std::mutex> lock(sResourceLock);
+			data = appResources->LoadResource(kCardPreviewsResourceType,
+				kCardPreviewsResourceID, &size);
+			if (data != NULL)
+				sPreviewBytes = size;
+		}
+		const CardPreviewsHeader* header = static_cast<const CardPreviewsHeader*>(data);
+		if (data == NULL || size < sizeof(CardPreviewsHeader)
+			|| header->magic != kCardPreviewsMagic || header->version != kCardPreviewsVersion
+			|| header->entryCount
+				> (size - sizeof(CardPreviewsHeader)) / sizeof(CardPreviewEntry)) {
+			return sources;
+		}
+
+		const CardPreviewEntry* entries = reinterpret_cast<const CardPreviewEntry*>(header + 1);
+		const uint8* pixels = reinterpret_cast<const uint8*>(entries + header->entryCount);
+		size_t pixelsSize = static_cast<const uint8*>(data) + size - pixels;
+		for (uint32 i = 0; i < header->entryCount; i++) {
+			const CardPreviewEntry& entry = entries[i];
+			if (entry.width <= 0 || entry.height <= 0 || entry.offset > pixelsSize
+				|| static_cast<uint64>(entry.width) * entry.height * 4
+					> pixelsSize - entry.offset) {
+				continue;
+			}
+
+			Source source = {entry.width, entry.height, pixels + entry.offset};
+			sources[entry.resourceID] = source;
+		}
+		return sources;
+	}();
+
+	auto it = sSources.find(resourceID);
+	if (it == sSources.end())
+		return std::shared_ptr<BBitmap>();
+
+	const Source& source = it->second;
+	std::shared_ptr<BBitmap> preview(
+		new BBitmap(BRect(0, 0, source.width - 1, source.height - 1), B_RGBA32));
+	if (preview->InitCheck() != B_OK)
+		return std::shared_ptr<BBitmap>();
+
+	int32 rowBytes = source.width * 4;
+	uint8* bits = static_cast<uint8*>(preview->Bits());
+	for (int32 y = 0; y < source.height; y++) {
+		memcpy(bits + static_cast<size_t>(y) * preview->BytesPerRow(),
+			source.pixels + static_cast<size_t>(y) * rowBytes, rowBytes);
+	}
+	return preview;
+}
+
+
+uint64
+BitmapCache::ResourceFingerprint()
+{
+	static const uint64 sFingerprint = []() {
+		// 64-bit FNV-1a over the ID, size and name of every card image, and
+		// the modification time of the application file. Hashing the image
+		// data itself would mean reading every card at startup.
+		uint64 hash = 14695981039346656037ULL;
+		auto add = [&hash](const void* data, size_t size) {
+			const uint8* bytes = static_cast<const uint8*>(data);
+			for (size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ULL;
+			}
+		};
+
+		BResources* appResources = BApplication::AppResources();
+		if (appResources != NULL) {
+			std::lock_guard<std::mutex> lock(sResourceLock);
+			int32 id;
+			const char* name;
+			size_t size;
+			for (int32 i = 0; appResources->GetResourceInfo('BBMP', i, &id, &name, &size);
+				i++) {
+				uint64 length = size;
+				add(&id, sizeof(id));
+				add(&length, sizeof(length));
+				if (name != NULL)
+					add(name, strlen(name));
+			}
+		}
+
+		app_info info;
+		time_t modified;
+		if (be_app != NULL && be_app->GetAppInfo(&info) == B_OK
+			&& BEntry(&info.ref).GetModificationTime(&modified) == B_OK) {
+			int64 time = modified;
+			add(&time, sizeof(time));
+		}
+		return hash;
+	}();
+	return sFingerprint;
+}
+
+
+bool
+BitmapCache::Key::operator<(const Key& other) const
+{
+	if (resourceID != other.resourceID)
+		return resourceID < other.resourceID;
+	if (boxWidth != other.boxWidth)
+		return boxWidth < other.boxWidth;
+	return boxHeight < other.boxHeight;
+}
+
+
+std::shared_ptr<BBitmap>
+BitmapCache::LookupLocked(const Key& key)
+{
+	auto it = fIndex.find(key);
+	if (it == fIndex.end())
+		return std::shared_ptr<BBitmap>();
+
+	fRecent.splice(fRecent.begin(), fRecent, it->second);
+	fHits++;
+	return it->second->bitmap;
+}
+
+
+std::shared_ptr<BBitmap>
+BitmapCache::InsertLocked(const Key& key, const std::shared_ptr<BBitmap>& bitmap)
+{
+	// Another thread may have stored the same image in the meantime; share
+	// its bitmap so that only one copy stays around
+	auto it = fIndex.find(key);
+	if (it != fIndex.end()) {
+		fRecent.splice(fRecent.begin(), fRecent, it->second);
+		return it->second->bitmap;
+	}
+
+	Entry entry = {key, bitmap, static_cast<size_t>(bitmap->BitsLength())};
+	fRecent.push_front(entry);
+	fIndex[key] = fRecent.begin();
+	fUsage += entry.size;
+	EvictLocked();
+	return bitmap;
+}
+
+
+void
+BitmapCache::EvictLocked()
+{
+	// Bitmaps still shown somewhere are skipped: dropping them would free
+	// nothing and only cause the card to be decoded a second time.
+	auto it = fRecent.end();
+	while (fUsage > fBudget && it != fRecent.begin()) {
+		--it;
+		if (it->bitmap.use_count() > 1)
+			continue;
+
+		fUsage -= it->size;
+		fIndex.erase(it->key);
+		it = fRecent.erase(it);
+		fEvictions++;
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <String.h>
+#include <SupportDefs.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+class BBitmap;
+
+// Decoded card images shared between readings, keyed by resource ID and, for
+// copies scaled down for display, the size of the box they were fitted into.
+// Callers get a reference-counted bitmap that stays valid for as long as they
+// hold it. Bitmaps nobody holds are evicted least recently used first once
+// the cache grows past its memory budget.
+class BitmapCache {
+public:
+	static BitmapCache& Default();
+
+	// Returns the decoded image of a card, decoding it on a miss. Safe to
+	// call from any thread; returns NULL if the image cannot be decoded.
+	std::shared_ptr<BBitmap> Get(int32 resourceID);
+	// Returns the image of a card only if it is already decoded.
+	std::shared_ptr<BBitmap> Lookup(int32 resourceID);
+
+	// Copies of card images scaled to fit a box of the given size. Lookup()
+	// and Contains() only look at memory; Insert() also hands the copy to
+	// the DiskBitmapCache unless it came from there.
+	std::shared_ptr<BBitmap> Lookup(int32 resourceID, int32 boxWidth, int32 boxHeight);
+	bool Contains(int32 resourceID, int32 boxWidth, int32 boxHeight) const;
+	void Insert(int32 resourceID, int32 boxWidth, int32 boxHeight,
+		const std::shared_ptr<BBitmap>& bitmap, bool keepOnDisk = true);
+	// Reads the copy an earlier launch left in the DiskBitmapCache without
+	// adding it to memory, or returns NULL. This reads a file, so it is not
+	// meant for the window thread.
+	static std::shared_ptr<BBitmap> LookupStored(int32 resourceID, int32 boxWidth,
+		int32 boxHeight);
+
+	uint64 Hits() const { return fHits.load(); }
+	uint64 Misses() const { return fMisses.load(); }
+	uint64 Evictions() const { return fEvictions.load(); }
+
+	// A table of the memory held for each card: the size of its compressed
+	// image, the compressed bytes read for decodes still in progress, and
+	// the decoded copies in the cache.
+	BString MemoryReport() const;
+
+	void Clear();
+
+	// Decodes the full resolution image of a card without caching it.
+	static BBitmap* Decode(int32 resourceID);
+	// Like Decode, but may return a smaller image as long as it does not
+	// have to be enlarged to fit a box of the given size. WebP images are
+	// decoded at the size that fits the box.
+	static BBitmap* Decode(int32 resourceID, int32 boxWidth, int32 boxHeight);
+
+	// A tiny, blurry copy of a card from the previews built into the
+	// application, to show while the card is decoded. NULL if there is none.
+	static std::shared_ptr<BBitmap> Preview(int32 resourceID);
+
+	// Hash of the card images in the application's resources, which changes
+	// whenever the application is rebuilt.
+	static uint64 ResourceFingerprint();
+
+private:
+	struct Key {
+		int32 resourceID;
+		int32 boxWidth; // 0 for the full resolution image
+		int32 boxHeight;
+
+		bool operator<(const Key& other) const;
+	};
+
+	struct Entry {
+		Key key;
+		std::shared_ptr<BBitmap> bitmap;
+		size_t size;
+	};
+
+	BitmapCache();
+	~BitmapCache();
+
+	static BBitmap* DecodeResource(int32 resourceID, int32 boxWidth, int32 boxHeight);
+	static BBitmap* DecodeWebP(const void* data, size_t size, int32 boxWidth,
+		int32 boxHeight);
+
+	std::shared_ptr<BBitmap> LookupLocked(const Key& key);
+	std::shared_ptr<BBitmap> InsertLocked(const Key& key, const std::shared_ptr<BBitmap>& bitmap);
+	void EvictLocked();
+
+	mutable std::mutex fLock;
+	std::list<Entry> fRecent; // Most recently used first
+	std::map<Key, std::list<Entry>::iterator> fIndex;
+	const size_t fBudget;
+	size_t fUsage;
+
+	std::atomic<uint64> fHits;
+	std::atomic<uint64> fMisses;
+	std::atomic<uint64> fEvictions;
+};
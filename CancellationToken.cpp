@@ -0,0 +1,42 @@
+#include "CancellationToken.h"
+
+
+CancellationToken::CancellationToken()
+	:
+	fCancelled(false)
+{
+}
+
+
+void
+CancellationToken::Cancel()
+{
+	fCancelled = true;
+
+	std::lock_guard<std::mutex> lock(fLock);
+	if (fWakeHook)
+		fWakeHook();
+}
+
+
+bool
+CancellationToken::IsCancelled() const
+{
+	return fCancelled.load();
+}
+
+
+void
+CancellationToken::SetWakeHook(const std::function<void()>& hook)
+{
+	std::lock_guard<std::mutex> lock(fLock);
+	fWakeHook = hook;
+}
+
+
+void
+CancellationToken::ClearWakeHook()
+{
+	std::lock_guard<std::mutex> lock(fLock);
+	fWakeHook = nullptr;
+}
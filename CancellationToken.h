@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+// Lets one thread abort work that another thread is blocked on. The thread
+// doing the work installs a wake hook while it waits, so that Cancel() can
+// interrupt the wait instead of being noticed only when it ends.
+class CancellationToken {
+public:
+	CancellationToken();
+
+	void Cancel();
+	bool IsCancelled() const;
+
+	void SetWakeHook(const std::function<void()>& hook);
+	void ClearWakeHook();
+
+private:
+	std::atomic<bool> fCancelled;
+	std::mutex fLock;
+	std::function<void()> fWakeHook;
+};
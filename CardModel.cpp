@@ -61,6 +61,15 @@ CardModel::GetCardSpread(std::vector<CardInfo>& cards, int32 numCards)
 		return;
 	}
 
+	DrawSpread(cards, numCards);
+	if (!cards.empty())
+		fCurrentSpread = cards;
+}
+
+
+void
+CardModel::DrawSpread(std::vector<CardInfo>& cards, int32 numCards) const
+{
 	cards.clear();
 
 	if (fCardResources.size() < static_cast<size_t>(numCards))
@@ -91,12 +100,11 @@ CardModel::GetCardSpread(std::vector<CardInfo>& cards, int32 numCards)
 		info.displayName = FormatCardName(fCardResources[selectedIndices[i]].name);
 		cards.push_back(info);
 	}
-	fCurrentSpread = cards;
 }
 
 
 BString
-CardModel::FormatCardName(const BString& resourceName)
+CardModel::FormatCardName(const BString& resourceName) const
 {
 	// Remove file extension
 	BString name = resourceName;
@@ -205,3 +213,12 @@ CardModel::GetResourceID(const BString& displayName)
 	}
 	return -1; // Not found
 }
+
+
+void
+CardModel::GetResourceIDs(std::vector<int32>& resourceIDs) const
+{
+	resourceIDs.clear();
+	for (size_t i = 0; i < fCardResources.size(); ++i)
+		resourceIDs.push_back(fCardResources[i].id);
+}
@@ -23,10 +23,13 @@ public:
 
 	status_t Initialize();
 	void GetCardSpread(std::vector<CardInfo>& cards, int32 numCards);
+	// Draws random cards without making them the current spread
+	void DrawSpread(std::vector<CardInfo>& cards, int32 numCards) const;
 	void SetCardSpread(const std::vector<CardInfo>& cards);
 	void ClearCurrentSpread();
-	BString FormatCardName(const BString& resourceName);
+	BString FormatCardName(const BString& resourceName) const;
 	int32 GetResourceID(const BString& displayName);
+	void GetResourceIDs(std::vector<int32>& resourceIDs) const;
 
 private:
 	std::vector<CardResourceInfo> fCardResources;
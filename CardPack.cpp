@@ -0,0 +1,179 @@
+#include "CardPack.h"
+
+#include <Bitmap.h>
+#include <Path.h>
+#include <image.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+CardPack&
+CardPack::Default()
+{
+	static CardPack sPack;
+	static bool sOpened = []() {
+		// The pack is installed next to the executable
+		image_info info;
+		int32 cookie = 0;
+		while (get_next_image_info(B_CURRENT_TEAM, &cookie, &info) == B_OK) {
+			if (info.type != B_APP_IMAGE)
+				continue;
+
+			BPath path(info.name);
+			if (path.GetParent(&path) == B_OK && path.Append(kCardPackFileName) == B_OK)
+				sPack.SetTo(path.Path());
+			break;
+		}
+		return true;
+	}();
+	(void)sOpened;
+
+	return sPack;
+}
+
+
+CardPack::CardPack()
+	:
+	fBase(NULL),
+	fSize(0),
+	fEntries(NULL),
+	fEntryCount(0)
+{
+}
+
+
+CardPack::~CardPack()
+{
+	Unset();
+}
+
+
+status_t
+CardPack::SetTo(const char* path)
+{
+	Unset();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return B_ENTRY_NOT_FOUND;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(CardPackHeader))) {
+		close(fd);
+		return B_BAD_DATA;
+	}
+
+	void* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return B_NO_MEMORY;
+
+	fBase = base;
+	fSize = st.st_size;
+
+	const CardPackHeader* header = static_cast<const CardPackHeader*>(fBase);
+	if (header->magic != kCardPackMagic || header->version != kCardPackVersion
+		|| header->entryCount > (fSize - sizeof(CardPackHeader)) / sizeof(CardPackEntry)) {
+		Unset();
+		return B_BAD_DATA;
+	}
+
+	const CardPackEntry* entries = reinterpret_cast<const CardPackEntry*>(header + 1);
+	for (uint32 i = 0; i < header->entryCount; i++) {
+		const CardPackEntry& entry = entries[i];
+		if (entry.width <= 0 || entry.height <= 0 || entry.bytesPerRow < entry.width * 4
+			|| entry.offset % kCardPackAlignment != 0 || entry.offset > fSize
+			|| static_cast<uint64>(entry.bytesPerRow) * entry.height > fSize - entry.offset) {
+			Unset();
+			return B_BAD_DATA;
+		}
+	}
+
+	fEntries = entries;
+	fEntryCount = header->entryCount;
+	return B_OK;
+}
+
+
+void
+CardPack::Unset()
+{
+	if (fBase != NULL)
+		munmap(fBase, fSize);
+
+	fBase = NULL;
+	fSize = 0;
+	fEntries = NULL;
+	fEntryCount = 0;
+}
+
+
+BBitmap*
+CardPack::Bitmap(int32 resourceID) const
+{
+	for (uint32 i = 0; i < fEntryCount; i++) {
+		if (fEntries[i].resourceID == resourceID && fEntries[i].level == 0)
+			return Copy(fEntries[i]);
+	}
+	return NULL;
+}
+
+
+BBitmap*
+CardPack::Bitmap(int32 resourceID, int32 width, int32 height) const
+{
+	// Levels get smaller as they go up
+	const CardPackEntry* largest = NULL;
+	const CardPackEntry* best = NULL;
+	for (uint32 i = 0; i < fEntryCount; i++) {
+		const CardPackEntry& entry = fEntries[i];
+		if (entry.resourceID != resourceID)
+			continue;
+
+		if (largest == NULL || entry.level < largest->level)
+			largest = &entry;
+		if ((entry.width >= width || entry.height >= height)
+			&& (best == NULL || entry.level > best->level)) {
+			best = &entry;
+		}
+	}
+
+	if (best == NULL)
+		best = largest;
+	return best != NULL ? Copy(*best) : NULL;
+}
+
+
+BBitmap*
+CardPack::Copy(const CardPackEntry& entry) const
+{
+	// A bitmap placed on the mapping itself would be drawn from an area that
+	// app_server cannot clone, so the pixels go into a bitmap of its own
+	BBitmap* bitmap = new BBitmap(BRect(0, 0, entry.width - 1, entry.height - 1), B_RGBA32);
+	status_t status = bitmap->InitCheck();
+	if (status != B_OK) {
+		static bool sReported = false;
+		if (!sReported) {
+			fprintf(stderr, "Card pack: cannot create a %" B_PRId32 "x%" B_PRId32
+				" bitmap: %s\n", entry.width, entry.height, strerror(status));
+			sReported = true;
+		}
+		delete bitmap;
+		return NULL;
+	}
+
+	const uint8* source = static_cast<const uint8*>(fBase) + entry.offset;
+	uint8* target = static_cast<uint8*>(bitmap->Bits());
+	size_t rowLength = static_cast<size_t>(entry.width) * 4;
+	for (int32 y = 0; y < entry.height; y++) {
+		memcpy(target, source, rowLength);
+		source += entry.bytesPerRow;
+		target += bitmap->BytesPerRow();
+	}
+	return bitmap;
+}
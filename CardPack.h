@@ -0,0 +1,36 @@
+#pragma once
+
+#include "CardPackFormat.h"
+
+#include <SupportDefs.h>
+
+class BBitmap;
+
+// Read-only access to the card pack installed next to the application. The
+// file is mapped into memory once; the bitmaps handed out are copied from the
+// mapped pixels, so showing a card costs a copy instead of a decode.
+class CardPack {
+public:
+	static CardPack& Default();
+
+	status_t SetTo(const char* path);
+	void Unset();
+	bool IsValid() const { return fEntries != NULL; }
+
+	// The largest stored size of a card, or NULL if it is not in the pack.
+	BBitmap* Bitmap(int32 resourceID) const;
+	// The smallest stored size that does not have to be enlarged to fit a
+	// box of width x height pixels, falling back to the largest.
+	BBitmap* Bitmap(int32 resourceID, int32 width, int32 height) const;
+
+private:
+	CardPack();
+	~CardPack();
+
+	BBitmap* Copy(const CardPackEntry& entry) const;
+
+	void* fBase;
+	size_t fSize;
+	const CardPackEntry* fEntries;
+	uint32 fEntryCount;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <SupportDefs.h>
+
+// Layout of the card pack written by tools/card-pack and read by CardPack.
+// The file starts with a CardPackHeader, followed by entryCount entries and
+// then the pixel data. Every card is stored at several sizes ("levels"),
+// largest first, as B_RGBA32 rows. Pixel data starts on page boundaries so
+// that levels can be mapped and used in place. Numbers are in the byte order
+// of the machine that built the pack.
+
+static const uint32 kCardPackMagic = 'ACPK';
+static const uint32 kCardPackVersion = 1;
+static const uint32 kCardPackAlignment = 4096;
+static const char kCardPackFileName[] = "cards.pack";
+
+struct CardPackHeader {
+	uint32 magic;
+	uint32 version;
+	uint32 entryCount;
+	uint32 reserved;
+};
+
+struct CardPackEntry {
+	int32 resourceID; // ID of the card in CardResources.rdef
+	int32 level; // 0 for the largest size
+	int32 width;
+	int32 height;
+	int32 bytesPerRow;
+	uint32 reserved;
+	uint64 offset; // From the start of the file
+};
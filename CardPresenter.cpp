@@ -1,9 +1,12 @@
 #include "CardPresenter.h"
 #include "AIReading.h"
+#include "BitmapCache.h"
+#include "CancellationToken.h"
 #include "CardModel.h"
 #include "CardView.h"
 #include "Config.h"
 #include "Reading.h"
+#include <Bitmap.h>
 #include <Directory.h>
 #include <File.h>
 #include <FindDirectory.h>
@@ -16,11 +19,43 @@
 #include <thread>
 
 
+static BString
+ComposeReading(const std::vector<CardInfo>& cards, SpreadType spread,
+	const AIReading::DeltaCallback& onDelta, CancellationToken* cancelToken,
+	bool* succeeded = NULL)
+{
+	if (Config::GetAPIKey().IsEmpty()) {
+		std::vector<BString> cardNames;
+		for (const auto& card : cards)
+			cardNames.push_back(card.displayName);
+		Reading basicReading(cardNames);
+		if (succeeded != NULL)
+			*succeeded = true;
+		return basicReading.GetInterpretation();
+	}
+
+	// Get an AI reading for the cards
+	return AIReading::GetReading(cards, spread, onDelta, cancelToken, succeeded);
+}
+
+
+CardPresenter::PreparedSpread::PreparedSpread()
+	:
+	spread(THREE_CARD),
+	bypassCache(false),
+	state(kQueued),
+	succeeded(false),
+	adopted(false),
+	adoptedGeneration(0)
+{
+}
+
+
 CardPresenter::CardPresenter(CardModel* model, CardView* view)
 	:
 	fModel(model),
 	fView(view),
-	fReading(nullptr),
+	fExecutor(Config::kReadingWorkerCount),
 	fCurrentReading(""),
 	fSpread(Config::GetSpread())
 {
@@ -28,20 +63,35 @@ CardPresenter::CardPresenter(CardModel* model, CardView* view)
 		fModel->Initialize();
 	if (fView)
 		fView->SetSpread(fSpread);
+
+	if (fModel && fView && Config::GetPreloadDeck()) {
+		std::vector<int32> resourceIDs;
+		fModel->GetResourceIDs(resourceIDs);
+		fView->PreloadDeck(resourceIDs);
+	}
 }
 
 
 CardPresenter::~CardPresenter()
 {
-	// Wait for any ongoing reading generation to complete
-	if (fReadingFuture.valid())
-		fReadingFuture.wait();
+	// Abort the requests in flight so quitting does not wait for the network,
+	// then stop the workers before the model and view they use go away
+	CancelReading();
+	DiscardPrefetch();
+	fExecutor.Shutdown();
 
-	delete fReading;
 	delete fModel;
 }
 
 
+BString
+CardPresenter::GetCurrentReading() const
+{
+	std::lock_guard<std::mutex> lock(fReadingLock);
+	return fCurrentReading;
+}
+
+
 BView*
 CardPresenter::GetView()
 {
@@ -69,6 +119,9 @@ void
 CardPresenter::SetAPIKey(const BString& apiKey)
 {
 	Config::SetAPIKey(apiKey);
+
+	// Settings were changed, so a prepared reading may no longer be wanted
+	DiscardPrefetch();
 }
 
 
@@ -83,6 +136,9 @@ CardPresenter::SetSpread(const BString& spreadName)
 	else
 		return;
 
+	if (newSpread != fSpread)
+		DiscardPrefetch();
+
 	fSpread = newSpread;
 	Config::SetSpread(newSpread);
 	fView->SetSpread(newSpread);
@@ -97,14 +153,30 @@ CardPresenter::SetFontSize(float fontSize)
 }
 
 
+BString
+CardPresenter::DrawingReport()
+{
+	return fView->DrawingReport();
+}
+
+
 void
 CardPresenter::NewReading()
 {
+	// Results still on their way for the previous spread are now stale
+	CancelReading();
+	uint32 generation = fExecutor.AdvanceGeneration();
+	fView->SetReadingGeneration(generation);
+
 	fModel->ClearCurrentSpread();
-	if (fSpread == THREE_CARD)
-		LoadThreeCardSpread();
-	else if (fSpread == TREE_OF_LIFE)
-		LoadTreeOfLifeSpread();
+	if (!TakePreparedSpread(generation)) {
+		if (fSpread == THREE_CARD)
+			LoadThreeCardSpread();
+		else if (fSpread == TREE_OF_LIFE)
+			LoadTreeOfLifeSpread();
+	}
+
+	StartPrefetch();
 }
 
 
@@ -221,6 +293,8 @@ CardPresenter::OpenFile(const BPath& path)
 		expectedCardCount = Config::kTreeOfLifeSpreadCount;
 
 	if (loadedCards.size() == static_cast<size_t>(expectedCardCount)) {
+		CancelReading();
+		fView->SetReadingGeneration(fExecutor.AdvanceGeneration());
 		fModel->SetCardSpread(loadedCards);
 		fView->DisplayCards(loadedCards);
 		fView->DisplayReading(aiReadingText);
@@ -241,29 +315,7 @@ CardPresenter::LoadThreeCardSpread()
 
 	fView->DisplayReading("Fetching reading...");
 
-	// Launch asynchronous task to get the reading
-	fReadingFuture = std::async(std::launch::async, [this, cards]() {
-		BString reading;
-		if (Config::GetAPIKey().IsEmpty()) {
-			std::vector<BString> cardNames;
-			for (const auto& card : cards)
-				cardNames.push_back(card.displayName);
-			fReading = new Reading(cardNames);
-			reading = fReading->GetInterpretation();
-		} else {
-			// Get an AI reading for the cards
-			reading = AIReading::GetReading(cards, fSpread);
-		}
-
-		fCurrentReading = reading;
-
-		// Log the reading if enabled
-		if (Config::GetLogReadings())
-			SaveReadingToFile(cards, reading);
-
-		// Update the UI with the reading in a thread-safe manner
-		fView->UpdateReading(reading);
-	});
+	RequestReading(cards);
 }
 
 
@@ -279,33 +331,219 @@ CardPresenter::LoadTreeOfLifeSpread()
 	// Show loading message while fetching AI reading
 	fView->DisplayReading("Fetching reading...");
 
-	// Launch asynchronous task to get the reading
-	fReadingFuture = std::async(std::launch::async, [this, cards]() {
-		BString reading;
-		if (Config::GetAPIKey().IsEmpty()) {
-			std::vector<BString> cardNames;
-			for (const auto& card : cards)
-				cardNames.push_back(card.displayName);
-			fReading = new Reading(cardNames);
-			reading = fReading->GetInterpretation();
-		} else {
-			// Get an AI reading for the cards
-			reading = AIReading::GetReading(cards, fSpread);
-		}
+	RequestReading(cards);
+}
 
+
+void
+CardPresenter::RequestReading(const std::vector<CardInfo>& cards)
+{
+	SpreadType spread = fSpread;
+	std::shared_ptr<CancellationToken> cancelToken = std::make_shared<CancellationToken>();
+	fCancelToken = cancelToken;
+
+	// Hand the reading to the executor; this returns immediately even if an
+	// earlier reading is still in flight, and that one's result is dropped.
+	fExecutor.Submit(TaskExecutor::kInteractiveLane,
+		[this, cards, spread, cancelToken](uint32 generation) {
+			if (!fExecutor.IsCurrent(generation))
+				return;
+
+			// Show the AI reading as it streams in if enabled
+			AIReading::DeltaCallback onDelta;
+			if (Config::GetStreamReadings()) {
+				onDelta = [this, generation](const BString& delta) {
+					fView->AppendReading(delta, generation);
+				};
+			}
+
+			BString reading = ComposeReading(cards, spread, onDelta, cancelToken.get());
+			PublishReading(cards, reading, generation);
+		});
+}
+
+
+void
+CardPresenter::CancelReading()
+{
+	if (fCancelToken) {
+		fCancelToken->Cancel();
+		fCancelToken.reset();
+	}
+}
+
+
+void
+CardPresenter::PublishReading(const std::vector<CardInfo>& cards, const BString& reading,
+	uint32 generation)
+{
+	if (!fExecutor.IsCurrent(generation))
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(fReadingLock);
 		fCurrentReading = reading;
+	}
 
+	// Log the reading if enabled
+	if (Config::GetLogReadings())
+		SaveReadingToFile(cards, reading);
 
-		// Log the reading if enabled
-		if (Config::GetLogReadings())
-			SaveReadingToFile(cards, reading);
+	// Update the UI with the reading in a thread-safe manner
+	fView->UpdateReading(reading, generation);
+}
+
+
+void
+CardPresenter::StartPrefetch()
+{
+	if (!Config::GetPrefetchReadings() || fPrefetch)
+		return;
+
+	std::shared_ptr<PreparedSpread> prepared = std::make_shared<PreparedSpread>();
+	prepared->spread = fSpread;
+	prepared->cancelToken = std::make_shared<CancellationToken>();
+	prepared->endpoint = Config::GetAPIEndpoint();
+	prepared->bypassCache = Config::GetBypassReadingCache();
+	fModel->DrawSpread(prepared->cards,
+		fSpread == THREE_CARD ? Config::kThreeCardSpreadCount : Config::kTreeOfLifeSpreadCount);
+	if (prepared->cards.empty())
+		return;
+
+	fPrefetch = prepared;
 
-		// Update the UI with the reading in a thread-safe manner
-		fView->UpdateReading(reading);
+	fExecutor.Submit(TaskExecutor::kBackgroundLane, [this, prepared](uint32) {
+		{
+			std::lock_guard<std::mutex> lock(prepared->lock);
+			if (prepared->state != PreparedSpread::kQueued)
+				return;
+			prepared->state = PreparedSpread::kRunning;
+		}
+
+		// Decoding through the cache keeps the images for later readings too
+		std::vector<std::shared_ptr<BBitmap>> bitmaps;
+		for (size_t i = 0; i < prepared->cards.size(); i++)
+			bitmaps.push_back(BitmapCache::Default().Get(prepared->cards[i].resourceID));
+
+		bool succeeded;
+		BString reading = ComposeReading(prepared->cards, prepared->spread,
+			AIReading::DeltaCallback(), prepared->cancelToken.get(), &succeeded);
+
+		bool adopted;
+		uint32 generation;
+		{
+			std::lock_guard<std::mutex> lock(prepared->lock);
+			prepared->bitmaps.swap(bitmaps);
+			prepared->reading = reading;
+			prepared->succeeded = succeeded;
+			adopted = prepared->adopted && prepared->state == PreparedSpread::kRunning;
+			generation = prepared->adoptedGeneration;
+			if (prepared->state == PreparedSpread::kRunning)
+				prepared->state = PreparedSpread::kDone;
+		}
+
+		// The user already moved on to this spread while it was being prepared
+		if (!adopted || prepared->cancelToken->IsCancelled())
+			return;
+
+		if (!succeeded) {
+			// A prepared reading that failed or timed out is never shown; ask
+			// again the way a spread drawn on the spot does
+			if (!fExecutor.IsCurrent(generation))
+				return;
+
+			AIReading::DeltaCallback onDelta;
+			if (Config::GetStreamReadings()) {
+				onDelta = [this, generation](const BString& delta) {
+					fView->AppendReading(delta, generation);
+				};
+			}
+			reading = ComposeReading(prepared->cards, prepared->spread, onDelta,
+				prepared->cancelToken.get());
+		}
+		PublishReading(prepared->cards, reading, generation);
 	});
 }
 
 
+bool
+CardPresenter::TakePreparedSpread(uint32 generation)
+{
+	std::shared_ptr<PreparedSpread> prepared = fPrefetch;
+	fPrefetch.reset();
+	if (!prepared)
+		return false;
+
+	if (prepared->spread != fSpread || !Config::GetPrefetchReadings()
+		|| prepared->endpoint != Config::GetAPIEndpoint()
+		|| prepared->bypassCache != Config::GetBypassReadingCache()) {
+		std::lock_guard<std::mutex> lock(prepared->lock);
+		prepared->state = PreparedSpread::kDiscarded;
+		prepared->cancelToken->Cancel();
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(prepared->lock);
+	if (prepared->state == PreparedSpread::kQueued) {
+		// Never started, so there is nothing to gain over a regular reading
+		prepared->state = PreparedSpread::kDiscarded;
+		return false;
+	}
+
+	fModel->SetCardSpread(prepared->cards);
+
+	if (prepared->state == PreparedSpread::kDone) {
+		std::vector<std::shared_ptr<BBitmap>> bitmaps;
+		bitmaps.swap(prepared->bitmaps);
+		BString reading = prepared->reading;
+		bool succeeded = prepared->succeeded;
+		lock.unlock();
+
+		fView->DisplayCards(prepared->cards, bitmaps);
+		if (!succeeded) {
+			// The images are still good, but the reading is asked for again
+			fView->DisplayReading("Fetching reading...");
+			RequestReading(prepared->cards);
+			return true;
+		}
+
+		fView->DisplayReading(reading);
+		{
+			std::lock_guard<std::mutex> readingLock(fReadingLock);
+			fCurrentReading = reading;
+		}
+		if (Config::GetLogReadings())
+			SaveReadingToFile(prepared->cards, reading);
+		return true;
+	}
+
+	// Still running: show the cards now and let the task publish the reading
+	prepared->adopted = true;
+	prepared->adoptedGeneration = generation;
+	lock.unlock();
+
+	fCancelToken = prepared->cancelToken;
+	fView->DisplayCards(prepared->cards);
+	fView->DisplayReading("Fetching reading...");
+	return true;
+}
+
+
+void
+CardPresenter::DiscardPrefetch()
+{
+	if (!fPrefetch)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(fPrefetch->lock);
+		fPrefetch->state = PreparedSpread::kDiscarded;
+	}
+	fPrefetch->cancelToken->Cancel();
+	fPrefetch.reset();
+}
+
+
 void
 CardPresenter::SaveReadingToFile(const std::vector<CardInfo>& cards, const BString& reading)
 {
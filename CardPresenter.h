@@ -2,12 +2,15 @@
 
 #include "CardModel.h"
 #include "Reading.h"
+#include "TaskExecutor.h"
 #include <Path.h>
 #include <String.h>
-#include <future>
-#include <thread>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+class BBitmap;
+class CancellationToken;
 class CardModel;
 class CardView;
 class BView;
@@ -24,23 +27,58 @@ public:
 	void OnFrameResized();
 	void SaveFile(const BPath& path);
 	void OpenFile(const BPath& path);
-	BString GetCurrentReading() const { return fCurrentReading; }
+	BString GetCurrentReading() const;
 	BView* GetView();
 	void SetView(CardView* view); // New method to set the view
 	BString GetAPIKey();
 	void SetAPIKey(const BString& apiKey);
 	void SetSpread(const BString& spreadName);
 	void SetFontSize(float fontSize);
+	BString DrawingReport();
 
 private:
 	void LoadThreeCardSpread();
 	void LoadTreeOfLifeSpread();
+	void RequestReading(const std::vector<CardInfo>& cards);
+	void CancelReading();
+	void PublishReading(const std::vector<CardInfo>& cards, const BString& reading,
+		uint32 generation);
+
+	// A spread drawn ahead of time, with its card images and reading prepared
+	// on the background lane while the user looks at the current one.
+	struct PreparedSpread {
+		enum State { kQueued, kRunning, kDone, kDiscarded };
+
+		PreparedSpread();
+
+		SpreadType spread;
+		std::vector<CardInfo> cards;
+		std::shared_ptr<CancellationToken> cancelToken;
+		// Settings the reading was asked for with; it is of no use once they
+		// change
+		BString endpoint;
+		bool bypassCache;
+
+		std::mutex lock; // Guards everything below
+		State state;
+		std::vector<std::shared_ptr<BBitmap>> bitmaps;
+		BString reading;
+		bool succeeded; // Whether reading is a reading rather than an error
+		bool adopted; // Publish the reading for adoptedGeneration when done
+		uint32 adoptedGeneration;
+	};
+
+	void StartPrefetch();
+	bool TakePreparedSpread(uint32 generation);
+	void DiscardPrefetch();
 	void SaveReadingToFile(const std::vector<CardInfo>& cards, const BString& reading);
 
 	CardModel* fModel;
 	CardView* fView;
-	std::future<void> fReadingFuture;
-	Reading* fReading;
-	BString fCurrentReading;
+	TaskExecutor fExecutor;
+	std::shared_ptr<CancellationToken> fCancelToken; // For the reading in flight
+	std::shared_ptr<PreparedSpread> fPrefetch; // At most one speculative spread
+	mutable std::mutex fReadingLock;
+	BString fCurrentReading; // Written by executor workers, guarded by fReadingLock
 	SpreadType fSpread;
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <SupportDefs.h>
+
+// Layout of the card previews written by tools/card-pack --previews and built
+// into the application as a resource. A CardPreviewsHeader is followed by
+// entryCount entries and then the pixel data: a few pixels wide B_RGBA32 rows
+// per card, stored without padding. Numbers are in the byte order of the
+// machine that built the previews.
+
+static const uint32 kCardPreviewsMagic = 'ACPV';
+static const uint32 kCardPreviewsVersion = 1;
+static const uint32 kCardPreviewsResourceType = 'CPRV';
+static const int32 kCardPreviewsResourceID = 1;
+
+struct CardPreviewsHeader {
+	uint32 magic;
+	uint32 version;
+	uint32 entryCount;
+	uint32 reserved;
+};
+
+struct CardPreviewEntry {
+	int32 resourceID; // ID of the card in CardResources.rdef
+	int32 width;
+	int32 height;
+	uint32 offset; // From the start of the data, width * 4 bytes per row
+};
@@ -1,12 +1,17 @@
 #include "CardView.h"
+#include "BitmapCache.h"
 #include "CardModel.h"
 #include "Config.h"
+#include "DiskBitmapCache.h"
+#include "ImageScaler.h"
 
 #include <Application.h>
 #include <Bitmap.h>
 #include <BitmapStream.h>
 #include <LayoutBuilder.h>
 #include <Message.h>
+#include <OS.h>
+#include <Region.h>
 #include <Resources.h>
 #include <ScrollBar.h>
 #include <ScrollView.h>
@@ -15,11 +20,13 @@
 #include <TranslationUtils.h>
 #include <TranslatorRoster.h>
 #include <iostream>
+#include <math.h>
+#include <stdio.h>
 
 
 CardView::CardView(BRect frame)
 	:
-	BView(frame, "CardView", B_FOLLOW_ALL_SIDES, B_WILL_DRAW | B_FULL_UPDATE_ON_RESIZE),
+	BView(frame, "CardView", B_FOLLOW_ALL_SIDES, B_WILL_DRAW),
 	fReadingView(new BTextView("ReadingView")), // Initialize BTextView
 	fReading(""), // Initialize fReading
 	fCardWidth(Config::kInitialCardWidth),
@@ -27,8 +34,28 @@ CardView::CardView(BRect frame)
 	fLabelHeight(Config::kInitialLabelHeight), // Increased for better text display
 	fReadingAreaWidth(0),
 	fReadingAreaHeight(0),
+	fCardAreaHeight(0),
 	fPreferredSize(frame),
-	fSpread(THREE_CARD)
+	fLayoutDirty(0),
+	fLayoutQueued(false),
+	fLaidOutEmpty(true),
+	fFrameCount(0),
+	fCardsDrawn(0),
+	fPixelsDrawn(0),
+	fFrameTime(0),
+	fWorstFrameTime(0),
+	fComposite(NULL),
+	fCompositeView(NULL),
+	fCompositeValid(false),
+	fSpread(THREE_CARD),
+	fPendingGeneration(0),
+	fAppendQueued(false),
+	fReadingStreaming(false),
+	fReadingGeneration(0),
+	fDecoder(Config::kCardDecoderWorkerCount),
+	fScaledCardWidth(0),
+	fScaledCardHeight(0),
+	fScaler(Config::kCardScalerWorkerCount)
 {
 	SetViewColor(ui_color(B_PANEL_BACKGROUND_COLOR));
 
@@ -51,7 +78,19 @@ CardView::CardView(BRect frame)
 
 CardView::~CardView()
 {
+	// Decoding and scaling tasks post back to this view, so they have to be
+	// finished first
+	fPreloader.Stop();
+	fDecoder.Shutdown();
+	fScaler.Shutdown();
 	ClearCards();
+	delete fComposite;
+
+	// The view is only destroyed when the application quits; images scaled
+	// this session still go to disk, and the rest are released here rather
+	// than by static destructors whose order is unknown
+	DiskBitmapCache::Default().Shutdown();
+	BitmapCache::Default().Clear();
 }
 
 
@@ -62,8 +101,96 @@ CardView::MessageReceived(BMessage* message)
 		case 'UPDR':
 		{
 			BString reading;
-			if (message->FindString("reading", &reading) == B_OK)
+			uint32 generation;
+			if (message->FindUInt32("generation", &generation) != B_OK
+				|| generation != fReadingGeneration) {
+				break;
+			}
+			if (message->FindString("reading", &reading) == B_OK) {
+				// The final text supersedes anything still waiting to be appended
+				{
+					std::lock_guard<std::mutex> lock(fPendingLock);
+					fPendingReading = "";
+				}
 				DisplayReading(reading);
+			}
+			break;
+		}
+		case 'APDR':
+		{
+			BString pending;
+			uint32 generation;
+			{
+				std::lock_guard<std::mutex> lock(fPendingLock);
+				pending = fPendingReading;
+				generation = fPendingGeneration;
+				fPendingReading = "";
+				fAppendQueued = false;
+			}
+			if (pending.IsEmpty() || generation != fReadingGeneration)
+				break;
+
+			if (!fReadingStreaming) {
+				// The first streamed text replaces the "Fetching reading..." notice
+				fReadingStreaming = true;
+				fReading = pending;
+				fReadingView->SetText(pending.String());
+			} else {
+				fReading += pending;
+				fReadingView->Insert(fReadingView->TextLength(), pending.String(),
+					pending.Length());
+			}
+			MarkLayoutDirty(kReadingLayoutDirty);
+			break;
+		}
+		case 'LAYT':
+			fLayoutQueued = false;
+			UpdateLayout();
+			break;
+		case 'DECD':
+		{
+			std::vector<DecodedImage> finished;
+			{
+				std::lock_guard<std::mutex> lock(fDecodedLock);
+				finished.swap(fDecodedImages);
+			}
+
+			for (size_t i = 0; i < finished.size(); i++) {
+				const DecodedImage& image = finished[i];
+				if (!fDecoder.IsCurrent(image.generation) || image.index >= fCards.size())
+					continue;
+
+				CardDisplay& card = fCards[image.index];
+				if (image.fitsBox)
+					card.scaled = image.bitmap;
+				else
+					card.image = image.bitmap;
+				card.decoding = false;
+				card.composed = false;
+				ScaleCard(image.index);
+				Invalidate(card.frame);
+			}
+			break;
+		}
+		case 'SCLD':
+		{
+			std::vector<ScaledImage> finished;
+			{
+				std::lock_guard<std::mutex> lock(fScaledLock);
+				finished.swap(fScaledImages);
+			}
+
+			for (size_t i = 0; i < finished.size(); i++) {
+				const ScaledImage& image = finished[i];
+				// Skip images scaled for an earlier size or an earlier spread
+				if (!fScaler.IsCurrent(image.generation) || image.index >= fCards.size()
+					|| fCards[image.index].image != image.source) {
+					continue;
+				}
+				fCards[image.index].scaled = image.scaled;
+				fCards[image.index].composed = false;
+				Invalidate(fCards[image.index].frame);
+			}
 			break;
 		}
 		default:
@@ -78,118 +205,459 @@ CardView::AttachedToWindow()
 {
 	BView::AttachedToWindow();
 	AddChild(fReadingView);
-	LayoutCards();
-	LayoutReadingArea();
+	MarkLayoutDirty(kCardLayoutDirty | kReadingLayoutDirty);
+	UpdateLayout();
 }
 
 
 void
 CardView::Draw(BRect updateRect)
 {
+	bigtime_t start = system_time();
 	BView::Draw(updateRect);
 
-	if (fCards.empty()) {
-		// If there are no cards, draw a welcome message
-		SetHighColor(ui_color(B_PANEL_BACKGROUND_COLOR));
-		FillRect(Bounds());
+	// Drawing may get here before the queued layout does
+	UpdateLayout();
 
-		const char* message = "Choose New Reading from the Ace of Wands menu to get started";
+	// Only what lies in the update region is drawn; scrolling and partial
+	// invalidation leave the rest of the view on screen as it is
+	BRegion updateRegion;
+	GetClippingRegion(&updateRegion);
 
-		BFont font;
-		GetFont(&font);
+	if (fCards.empty())
+		DrawWelcome();
+	else
+		DrawCards(updateRegion);
+
+	// Counts the time taken to issue the drawing commands; the app_server
+	// carries them out on its own time
+	bigtime_t frameTime = system_time() - start;
+	fFrameCount++;
+	fFrameTime += frameTime;
+	if (frameTime > fWorstFrameTime)
+		fWorstFrameTime = frameTime;
+	for (int32 i = 0; i < updateRegion.CountRects(); i++) {
+		BRect rect = updateRegion.RectAt(i);
+		fPixelsDrawn += static_cast<int64>(rect.IntegerWidth() + 1) * (rect.IntegerHeight() + 1);
+	}
+}
+
+
+BString
+CardView::DrawingReport()
+{
+	BString report;
+	if (fFrameCount == 0) {
+		report << "Card view: no frames drawn\n";
+	} else {
+		char line[160];
+		snprintf(line, sizeof(line), "Card view: %" B_PRId64 " frames, %.2f ms average, "
+			"%.2f ms worst, %.1f cards and %" B_PRId64 " pixels per frame\n", fFrameCount,
+			fFrameTime / 1000.0 / fFrameCount, fWorstFrameTime / 1000.0,
+			static_cast<double>(fCardsDrawn) / fFrameCount, fPixelsDrawn / fFrameCount);
+		report << line;
+	}
 
-		font.SetSize(Config::GetFontSize());
-		SetFont(&font);
+	// Each report covers the frames since the one before
+	fFrameCount = 0;
+	fCardsDrawn = 0;
+	fPixelsDrawn = 0;
+	fFrameTime = 0;
+	fWorstFrameTime = 0;
+	return report;
+}
 
-		font_height fh;
-		font.GetHeight(&fh);
-		float stringWidth = font.StringWidth(message);
-		float stringHeight = fh.ascent + fh.descent;
 
-		BRect bounds = Bounds();
-		float x = bounds.left + (bounds.Width() - stringWidth) / 2;
-		float y = bounds.top + (bounds.Height() - stringHeight) / 2 + fh.ascent;
+void
+CardView::DrawWelcome()
+{
+	// If there are no cards, draw a welcome message
+	SetHighColor(ui_color(B_PANEL_BACKGROUND_COLOR));
+	FillRect(Bounds());
 
-		SetHighColor(ui_color(B_CONTROL_TEXT_COLOR));
-		DrawString(message, BPoint(x, y));
-		return;
-	}
+	const char* message = "Choose New Reading from the Ace of Wands menu to get started";
 
-	// Get the scroll offset
-	BPoint scrollOffset = LeftTop();
+	BFont font;
+	GetFont(&font);
+
+	font.SetSize(Config::GetFontSize());
+	SetFont(&font);
 
+	font_height fh;
+	font.GetHeight(&fh);
+	float stringWidth = font.StringWidth(message);
+	float stringHeight = fh.ascent + fh.descent;
 
 	BRect bounds = Bounds();
-	BRect cardArea(bounds.left + fReadingAreaWidth, bounds.top, bounds.right, bounds.bottom);
+	float x = bounds.left + (bounds.Width() - stringWidth) / 2;
+	float y = bounds.top + (bounds.Height() - stringHeight) / 2 + fh.ascent;
 
-	// Draw cards in the card area, accounting for scroll offset
-	for (size_t i = 0; i < fCards.size(); i++) {
-		// Adjust card frame to fit within card area and account for scroll offset
-		BRect cardFrame = fCards[i].frame;
-		cardFrame.OffsetBy(-scrollOffset.x,
-			-scrollOffset.y); // Adjust for both horizontal and vertical scroll
+	SetHighColor(ui_color(B_CONTROL_TEXT_COLOR));
+	DrawString(message, BPoint(x, y));
+}
 
-		// Only draw cards that are within the update rect
-		if (!updateRect.Intersects(cardFrame))
+
+void
+CardView::DrawCards(const BRegion& updateRegion)
+{
+	// Card frames are in view coordinates, so that they scroll along with the
+	// reading
+	if (ComposeCards()) {
+		if (updateRegion.Intersects(fCompositeFrame))
+			DrawBitmap(fComposite, fCompositeFrame.LeftTop());
+		return;
+	}
+
+	// Without memory for the offscreen spread the cards are drawn directly
+	for (size_t i = 0; i < fCards.size(); i++) {
+		// Only draw cards that are within the update region
+		if (!updateRegion.Intersects(fCards[i].frame))
 			continue;
+		fCardsDrawn++;
+		DrawCard(this, fCards[i], fCards[i].frame);
+	}
+}
 
-		// Draw image
-		if (fCards[i].image) {
-			BRect imageFrame = fCards[i].image->Bounds();
 
-			// Scale image to fit card frame while maintaining aspect ratio
-			// Leave a small margin around the image
-			BRect imageArea = cardFrame;
-			imageArea.InsetBy(Config::kImageInset, Config::kImageInset);
-			// Reduce inset at bottom to leave space for label
-			imageArea.bottom -= fLabelHeight - Config::kLabelHeightMargin;
+bool
+CardView::ComposeCards()
+{
+	BRect frame;
+	for (size_t i = 0; i < fCards.size(); i++) {
+		if (fCards[i].frame.IsValid())
+			frame = frame.IsValid() ? frame | fCards[i].frame : fCards[i].frame;
+	}
+	if (!frame.IsValid())
+		return false;
+	frame.Set(floorf(frame.left), floorf(frame.top), ceilf(frame.right), ceilf(frame.bottom));
+
+	if (fComposite == NULL || frame.IntegerWidth() != fCompositeFrame.IntegerWidth()
+		|| frame.IntegerHeight() != fCompositeFrame.IntegerHeight()) {
+		delete fComposite;
+		fComposite = new BBitmap(BRect(0, 0, frame.IntegerWidth(), frame.IntegerHeight()),
+			B_RGB32, true);
+		if (fComposite->InitCheck() != B_OK) {
+			delete fComposite;
+			fComposite = NULL;
+			fCompositeView = NULL;
+			return false;
+		}
 
-			float scaleX = imageArea.Width() / imageFrame.Width();
-			float scaleY = imageArea.Height() / imageFrame.Height();
-			float scale = scaleX < scaleY ? scaleX : scaleY;
+		fCompositeView = new BView(fComposite->Bounds(), "CardComposite", B_FOLLOW_NONE,
+			B_WILL_DRAW);
+		fComposite->Lock();
+		fComposite->AddChild(fCompositeView);
+		fComposite->Unlock();
+		fCompositeValid = false;
+	}
+	if (frame != fCompositeFrame) {
+		fCompositeFrame = frame;
+		fCompositeValid = false;
+	}
 
-			if (scale > 0) {
-				float scaledWidth = imageFrame.Width() * scale;
-				float scaledHeight = imageFrame.Height() * scale;
+	fComposite->Lock();
+	rgb_color background = ui_color(B_PANEL_BACKGROUND_COLOR);
+	if (!fCompositeValid) {
+		BFont font;
+		GetFont(&font);
+		fCompositeView->SetFont(&font);
+		fCompositeView->SetHighColor(background);
+		fCompositeView->FillRect(fCompositeView->Bounds());
+	}
 
-				BRect destRect(0, 0, scaledWidth, scaledHeight);
-				destRect.OffsetTo(imageArea.left + (imageArea.Width() - scaledWidth) / 2,
-					imageArea.top + (imageArea.Height() - scaledHeight) / 2);
+	// Only the cards whose images or state changed are drawn again
+	for (size_t i = 0; i < fCards.size(); i++) {
+		CardDisplay& card = fCards[i];
+		if (card.composed && fCompositeValid)
+			continue;
 
-				DrawBitmap(fCards[i].image, imageFrame, destRect);
-			}
-		}
+		BRect cardFrame = card.frame;
+		cardFrame.OffsetBy(-fCompositeFrame.left, -fCompositeFrame.top);
+		fCompositeView->SetHighColor(background);
+		fCompositeView->FillRect(cardFrame);
+		DrawCard(fCompositeView, card, cardFrame);
+		card.composed = true;
+		fCardsDrawn++;
+	}
+	fCompositeView->Sync();
+	fComposite->Unlock();
 
-		// Draw label with system default style
-		font_height fh;
-		GetFontHeight(&fh);
-		float labelY = cardFrame.bottom - (fLabelHeight / 2) + (fh.ascent / 2) - fh.descent / 2;
-
-		BString displayName = fCards[i].displayName;
-		float stringWidth = StringWidth(displayName.String());
-		float labelX = cardFrame.left + (cardFrame.Width() - stringWidth) / 2;
-
-		// Use system default colors for text
-		SetHighColor(ui_color(B_CONTROL_TEXT_COLOR));
-		SetLowColor(ui_color(B_CONTROL_BACKGROUND_COLOR));
-
-		// Ensure text is centered and fits in label area
-		if (stringWidth > cardFrame.Width() - Config::kCardWidthMargin) {
-			// Truncate if too long
-			BString truncatedName = displayName;
-			while (StringWidth(truncatedName.String())
-					> cardFrame.Width() - (2 * Config::kCardWidthMargin)
-				&& truncatedName.Length() > 3) {
-				truncatedName.Truncate(truncatedName.Length() - 4);
-				truncatedName.Append("...");
-			}
-			stringWidth = StringWidth(truncatedName.String());
-			labelX = cardFrame.left + (cardFrame.Width() - stringWidth) / 2;
-			DrawString(truncatedName.String(), BPoint(labelX, labelY));
+	fCompositeValid = true;
+	return true;
+}
+
+
+void
+CardView::DrawCard(BView* target, const CardDisplay& card, BRect cardFrame)
+{
+	// Draw image
+	if (card.image || card.scaled) {
+		BRect destRect = ImageFrame(card, cardFrame);
+		BBitmap* scaled = card.scaled.get();
+
+		if (!destRect.IsValid()) {
+			// Card too small to show the image
+		} else if (scaled != NULL && scaled->Bounds().IntegerWidth() == destRect.IntegerWidth()
+			&& scaled->Bounds().IntegerHeight() == destRect.IntegerHeight()) {
+			target->DrawBitmap(scaled, destRect.LeftTop());
 		} else {
-			DrawString(displayName.String(), BPoint(labelX, labelY));
+			// Until the image for this size is ready, let the app_server scale
+			// what we have; an older scaled copy is cheaper to filter than the
+			// full resolution original
+			BBitmap* bitmap = scaled != NULL ? scaled : card.image.get();
+			target->DrawBitmap(bitmap, bitmap->Bounds(), destRect);
+		}
+	} else if (card.preview) {
+		// Previews are only a few pixels wide; filtering keeps them from
+		// showing up as blocks
+		BRect destRect = ImageFrame(card, cardFrame);
+		if (destRect.IsValid()) {
+			BBitmap* preview = card.preview.get();
+			target->DrawBitmap(preview, preview->Bounds(), destRect, B_FILTER_BITMAP_BILINEAR);
+		}
+	} else {
+		// Placeholder while the image is being decoded
+		BRect imageArea = ImageArea(cardFrame, fLabelHeight);
+		if (imageArea.IsValid()) {
+			rgb_color background = ui_color(B_PANEL_BACKGROUND_COLOR);
+			target->SetHighColor(tint_color(background, B_DARKEN_1_TINT));
+			target->FillRect(imageArea);
+			target->SetHighColor(tint_color(background, B_DARKEN_2_TINT));
+			target->StrokeRect(imageArea);
 		}
 	}
+
+	// Draw label with system default style; its size and any truncation come
+	// from the label cache, so that drawing measures no text
+	BFont font;
+	target->GetFont(&font);
+	const font_height& fh = fLabelCache.FontHeight(font);
+	float labelY = cardFrame.bottom - (fLabelHeight / 2) + (fh.ascent / 2) - fh.descent / 2;
+
+	// Names that do not fit the label area are truncated with an ellipsis
+	const LabelCache::Label& label = fLabelCache.Fit(card.displayName, font,
+		cardFrame.Width() - Config::kCardWidthMargin,
+		cardFrame.Width() - (2 * Config::kCardWidthMargin));
+	float labelX = cardFrame.left + (cardFrame.Width() - label.width) / 2;
+
+	// Use system default colors for text
+	target->SetHighColor(ui_color(B_CONTROL_TEXT_COLOR));
+	target->SetLowColor(ui_color(B_CONTROL_BACKGROUND_COLOR));
+	target->DrawString(label.text.String(), BPoint(labelX, labelY));
+}
+
+
+BRect
+CardView::ImageArea(BRect cardFrame, float labelHeight) const
+{
+	// Leave a small margin around the image
+	BRect imageArea = cardFrame;
+	imageArea.InsetBy(Config::kImageInset, Config::kImageInset);
+	// Reduce inset at bottom to leave space for label
+	imageArea.bottom -= labelHeight - Config::kLabelHeightMargin;
+	return imageArea;
+}
+
+
+BRect
+CardView::ImageFrame(const CardDisplay& card, BRect cardFrame) const
+{
+	// The full image and its scaled copies share the same aspect ratio; the
+	// preview is close enough until they arrive
+	const BBitmap* reference = card.image ? card.image.get() : card.scaled.get();
+	if (reference == NULL)
+		reference = card.preview.get();
+	BRect imageArea = ImageArea(cardFrame, fLabelHeight);
+	if (reference == NULL || !imageArea.IsValid())
+		return BRect();
+
+	// Scale image to fit card frame while maintaining aspect ratio, in whole
+	// pixels so that an image scaled to this size is drawn without any
+	// further filtering
+	int32 boxWidth;
+	int32 boxHeight;
+	BoxSize(imageArea, boxWidth, boxHeight);
+
+	BRect bounds = reference->Bounds();
+	int32 width;
+	int32 height;
+	ImageScaler::FitSize(bounds.IntegerWidth() + 1, bounds.IntegerHeight() + 1, boxWidth,
+		boxHeight, width, height);
+
+	float left = floorf(imageArea.left) + (boxWidth - width) / 2;
+	float top = floorf(imageArea.top) + (boxHeight - height) / 2;
+	return BRect(left, top, left + width - 1, top + height - 1);
+}
+
+
+void
+CardView::BoxSize(BRect imageArea, int32& width, int32& height)
+{
+	width = static_cast<int32>(imageArea.Width()) + 1;
+	height = static_cast<int32>(imageArea.Height()) + 1;
+}
+
+
+void
+CardView::ScheduleScaling()
+{
+	// Anything still queued for the previous size is dropped
+	fScaler.AdvanceGeneration();
+	fScaledCardWidth = fCardWidth;
+	fScaledCardHeight = fCardHeight;
+
+	for (size_t i = 0; i < fCards.size(); i++)
+		ScaleCard(i);
+}
+
+
+void
+CardView::ScaleCard(size_t index)
+{
+	CardDisplay& card = fCards[index];
+	BRect imageArea = ImageArea(card.frame, fLabelHeight);
+	if (!imageArea.IsValid())
+		return;
+
+	BRect destRect = ImageFrame(card, card.frame);
+	if (card.scaled && card.scaled->Bounds().IntegerWidth() == destRect.IntegerWidth()
+		&& card.scaled->Bounds().IntegerHeight() == destRect.IntegerHeight()) {
+		return;
+	}
+
+	// An earlier reading or the DeckPreloader may have scaled the card for
+	// this size already. Copies an earlier launch left on disk are read by
+	// DecodeCard(), off the window thread.
+	int32 boxWidth;
+	int32 boxHeight;
+	BoxSize(imageArea, boxWidth, boxHeight);
+	std::shared_ptr<BBitmap> cached
+		= BitmapCache::Default().Lookup(card.resourceID, boxWidth, boxHeight);
+	if (cached) {
+		card.scaled = cached;
+		return;
+	}
+
+	if (!card.image) {
+		if (!card.decoding)
+			DecodeCard(index, boxWidth, boxHeight);
+		return;
+	}
+
+	int32 width = destRect.IntegerWidth() + 1;
+	int32 height = destRect.IntegerHeight() + 1;
+	int32 resourceID = card.resourceID;
+	std::shared_ptr<BBitmap> source = card.image;
+	fScaler.Submit(TaskExecutor::kInteractiveLane,
+		[this, index, resourceID, source, boxWidth, boxHeight, width, height](
+			uint32 generation) {
+			if (!fScaler.IsCurrent(generation))
+				return;
+
+			ScaledImage image;
+			image.index = index;
+			image.source = source;
+			image.scaled.reset(ImageScaler::ScaleBitmap(source.get(), width, height));
+			image.generation = generation;
+			if (!image.scaled)
+				return;
+
+			BitmapCache::Default().Insert(resourceID, boxWidth, boxHeight, image.scaled);
+			{
+				std::lock_guard<std::mutex> lock(fScaledLock);
+				fScaledImages.push_back(image);
+			}
+			if (Looper())
+				Looper()->PostMessage('SCLD', this);
+		});
+}
+
+
+void
+CardView::DecodeCard(size_t index, int32 boxWidth, int32 boxHeight)
+{
+	fCards[index].decoding = true;
+	int32 resourceID = fCards[index].resourceID;
+	fDecoder.Submit(TaskExecutor::kInteractiveLane,
+		[this, index, resourceID, boxWidth, boxHeight](uint32 generation) {
+			if (!fDecoder.IsCurrent(generation))
+				return;
+
+			DecodedImage image;
+			image.index = index;
+			image.generation = generation;
+
+			// An earlier launch may have stored the card at this size
+			image.bitmap = BitmapCache::LookupStored(resourceID, boxWidth, boxHeight);
+			if (image.bitmap) {
+				image.fitsBox = true;
+				BitmapCache::Default().Insert(resourceID, boxWidth, boxHeight, image.bitmap,
+					false);
+				{
+					std::lock_guard<std::mutex> lock(fDecodedLock);
+					fDecodedImages.push_back(image);
+				}
+				if (Looper())
+					Looper()->PostMessage('DECD', this);
+				return;
+			}
+
+			// Decoded straight at the size the card is drawn at where possible,
+			// otherwise at a size it can be scaled down from
+			fPreloader.BeginForegroundDecode();
+			std::shared_ptr<BBitmap> bitmap(
+				BitmapCache::Decode(resourceID, boxWidth, boxHeight));
+			fPreloader.EndForegroundDecode();
+			if (!bitmap)
+				return;
+
+			BRect bounds = bitmap->Bounds();
+			int32 width;
+			int32 height;
+			ImageScaler::FitSize(bounds.IntegerWidth() + 1, bounds.IntegerHeight() + 1,
+				boxWidth, boxHeight, width, height);
+
+			image.bitmap = bitmap;
+			image.fitsBox
+				= width == bounds.IntegerWidth() + 1 && height == bounds.IntegerHeight() + 1;
+			if (image.fitsBox)
+				BitmapCache::Default().Insert(resourceID, boxWidth, boxHeight, bitmap);
+
+			{
+				std::lock_guard<std::mutex> lock(fDecodedLock);
+				fDecodedImages.push_back(image);
+			}
+			if (Looper())
+				Looper()->PostMessage('DECD', this);
+		});
+}
+
+
+void
+CardView::UpdatePreloadTarget()
+{
+	// Preload at the size the cards of a full spread have once its reading
+	// is shown next to them
+	size_t cardCount = fSpread == TREE_OF_LIFE ? Config::kTreeOfLifeSpreadCount
+		: Config::kThreeCardSpreadCount;
+	float cardWidth;
+	float cardHeight;
+	float labelHeight;
+	CalculateCardSize(cardCount, Bounds().Width() * Config::kReadingAreaWidthRatio, cardWidth,
+		cardHeight, labelHeight);
+
+	BRect cardFrame(0, 0, cardWidth, cardHeight);
+	if (fSpread == THREE_CARD)
+		cardFrame.bottom += labelHeight;
+
+	BRect imageArea = ImageArea(cardFrame, labelHeight);
+	if (!imageArea.IsValid())
+		return;
+
+	int32 boxWidth;
+	int32 boxHeight;
+	BoxSize(imageArea, boxWidth, boxHeight);
+	fPreloader.SetTargetSize(boxWidth, boxHeight);
 }
 
 
@@ -197,20 +665,19 @@ void
 CardView::FrameResized(float width, float height)
 {
 	BView::FrameResized(width, height);
-	LayoutCards();
-	LayoutReadingArea();
-	Invalidate();
+	MarkLayoutDirty(kCardLayoutDirty | kReadingLayoutDirty);
 }
 
 
 void
 CardView::ScrollTo(BPoint where)
 {
-	// Call the parent implementation
+	// The app_server copies what stays in view and asks for the strips that
+	// scroll in. Only the welcome message, centered in the visible part of
+	// the view, has to be drawn again in full.
 	BView::ScrollTo(where);
-
-	// Redraw the view
-	Invalidate();
+	if (fCards.empty())
+		Invalidate();
 }
 
 
@@ -234,56 +701,19 @@ CardView::CalculateTextHeightForTextView(BTextView* textView, const BString& tex
 	if (width <= 0)
 		width = 300; // Default width for calculation
 
-	// Split the text into lines
-	BString textCopy = text;
+	// Paragraphs are wrapped one at a time, so that those seen before at this
+	// width come straight from the line breaker's memory
+	const char* string = text.String();
 	int32 start = 0;
-	int32 end = 0;
 	float totalHeight = 0;
 
-	while (start < textCopy.Length()) {
-		// Find the next line break
-		end = textCopy.FindFirst("\n", start);
+	while (start < text.Length()) {
+		int32 end = text.FindFirst('\n', start);
 		if (end == B_ERROR)
-			end = textCopy.Length();
-
-		// Get the line
-		BString line;
-		textCopy.CopyInto(line, start, end - start);
-
-		// Handle word wrapping
-		while (line.Length() > 0) {
-			// Find the portion that fits
-			BString displayLine = line;
-			// Use the font from the text view to calculate string width
-			while (font.StringWidth(displayLine.String()) > width && displayLine.Length() > 1) {
-				// Try to break at a space
-				int32 lastSpace = displayLine.FindLast(' ');
-				if (lastSpace != B_ERROR && lastSpace > 0) {
-					displayLine.Truncate(lastSpace);
-				} else {
-					// Just truncate
-					displayLine.Truncate(displayLine.Length() - 1);
-				}
-			}
+			end = text.Length();
 
-			// Add height for this line
-			totalHeight += lineHeight;
-
-			// Move to the next portion
-			if (displayLine.Length() < line.Length()) {
-				// Remove the displayed portion from line
-				if (displayLine.Length() < line.Length()) {
-					line.Remove(0, displayLine.Length());
-					// Remove leading spaces
-					while (line.Length() > 0 && line[0] == ' ')
-						line.Remove(0, 1);
-				} else {
-					line = "";
-				}
-			} else {
-				line = "";
-			}
-		}
+		int32 lines = fLineBreaker.CountLines(string + start, end - start, font, width);
+		totalHeight += lines * lineHeight;
 
 		// Move to the next line
 		start = end + 1;
@@ -329,12 +759,7 @@ CardView::LayoutReadingArea()
 	fReadingView->MoveTo(readingViewRect.left, readingViewRect.top);
 	fReadingView->ResizeTo(readingViewRect.Width(), readingViewRect.Height());
 
-	// Update the preferred size to accommodate the text height
-	// fPreferredSize is initially set by LayoutCards.
-	// We need to ensure it's large enough for the text as well.
-	if (fPreferredSize.Height() < textHeight + 50)
-		fPreferredSize.bottom = fPreferredSize.top + textHeight + 50; // Add some padding
-	// If LayoutCards has already set a larger preferred size, we keep it.
+	fReadingAreaHeight = textHeight + 50; // Add some padding
 }
 
 
@@ -356,6 +781,9 @@ BSize
 CardView::PreferredSize()
 {
 	// Return the preferred size which accounts for all content
+	if ((fLayoutDirty & kPreferredSizeDirty) != 0)
+		UpdateLayout();
+
 	// Ensure we return a valid size
 	if (fPreferredSize.Width() <= 0 || fPreferredSize.Height() <= 0)
 		return BView::PreferredSize();
@@ -365,6 +793,14 @@ CardView::PreferredSize()
 
 void
 CardView::DisplayCards(const std::vector<CardInfo>& cards)
+{
+	DisplayCards(cards, std::vector<std::shared_ptr<BBitmap>>());
+}
+
+
+void
+CardView::DisplayCards(const std::vector<CardInfo>& cards,
+	const std::vector<std::shared_ptr<BBitmap>>& bitmaps)
 {
 	ClearCards();
 
@@ -372,28 +808,30 @@ CardView::DisplayCards(const std::vector<CardInfo>& cards)
 		CardDisplay display;
 		display.displayName = cards[i].displayName;
 
-		// Load image from resources
-		BResources* appResources = BApplication::AppResources();
-		if (appResources) {
-			size_t size;
-			const void* data = appResources->LoadResource('BBMP', cards[i].resourceID, &size);
-			if (data) {
-				BMemoryIO stream(data, size);
-				display.image = BTranslationUtils::GetBitmap(&stream);
-			}
-		}
+		display.resourceID = cards[i].resourceID;
+		display.decoding = false;
+		display.composed = false;
+
+		// Cards missing from the cache are decoded once their size is known,
+		// unless a copy scaled for that size is found
+		if (i < bitmaps.size() && bitmaps[i] != NULL)
+			display.image = bitmaps[i];
+		else
+			display.image = BitmapCache::Default().Lookup(cards[i].resourceID);
+		if (!display.image && Config::GetShowCardPreviews())
+			display.preview = BitmapCache::Preview(cards[i].resourceID);
 
 		fCards.push_back(display);
 	}
 
-	LayoutCards();
-	Invalidate();
+	MarkLayoutDirty(kCardLayoutDirty);
 }
 
 
 void
 CardView::DisplayReading(const BString& reading)
 {
+	fReadingStreaming = false;
 	fReading = reading;
 	fReadingView->SetText(reading.String());
 	RefreshLayout();
@@ -401,13 +839,14 @@ CardView::DisplayReading(const BString& reading)
 
 
 void
-CardView::UpdateReading(const BString& reading)
+CardView::UpdateReading(const BString& reading, uint32 generation)
 {
 	// This method can be called from a background thread
 	// We need to synchronize with the UI thread
 	// BTextView is not thread-safe, so we need to use a message
 	BMessage* message = new BMessage('UPDR');
 	message->AddString("reading", reading);
+	message->AddUInt32("generation", generation);
 
 	// Post message to main thread
 	if (Looper())
@@ -418,14 +857,51 @@ CardView::UpdateReading(const BString& reading)
 
 
 void
-CardView::ClearCards()
+CardView::AppendReading(const BString& delta, uint32 generation)
 {
-	for (size_t i = 0; i < fCards.size(); i++) {
-		delete fCards[i].image;
-		fCards[i].image = NULL;
+	bool queueMessage;
+	{
+		std::lock_guard<std::mutex> lock(fPendingLock);
+		// Text left over from an older generation is of no use any more
+		if (generation != fPendingGeneration) {
+			fPendingReading = "";
+			fPendingGeneration = generation;
+		}
+		fPendingReading += delta;
+		queueMessage = !fAppendQueued;
+		fAppendQueued = true;
+	}
+
+	if (!queueMessage)
+		return;
+
+	if (Looper()) {
+		Looper()->PostMessage('APDR', this);
+	} else {
+		std::lock_guard<std::mutex> lock(fPendingLock);
+		fAppendQueued = false;
 	}
+}
+
+
+void
+CardView::SetReadingGeneration(uint32 generation)
+{
+	fReadingGeneration = generation;
+}
+
 
+void
+CardView::ClearCards()
+{
+	// The bitmaps stay in the BitmapCache for the next reading
+	InvalidateCards();
 	fCards.clear();
+	fCompositeValid = false;
+	fDecoder.AdvanceGeneration();
+	fScaler.AdvanceGeneration();
+	fScaledCardWidth = 0;
+	fScaledCardHeight = 0;
 	fReading = ""; // Clear the reading text
 	fReadingView->SetText(""); // Clear the reading view when cards are cleared
 	RefreshLayout();
@@ -435,9 +911,93 @@ CardView::ClearCards()
 void
 CardView::RefreshLayout()
 {
-	LayoutCards();
-	LayoutReadingArea();
-	Invalidate();
+	MarkLayoutDirty(kCardLayoutDirty | kReadingLayoutDirty);
+}
+
+
+void
+CardView::MarkLayoutDirty(uint32 parts)
+{
+	// The preferred size follows from both the cards and the reading
+	if ((parts & (kCardLayoutDirty | kReadingLayoutDirty)) != 0)
+		parts |= kPreferredSizeDirty;
+	fLayoutDirty |= parts;
+
+	if (fLayoutQueued || Looper() == NULL)
+		return;
+	fLayoutQueued = Looper()->PostMessage('LAYT', this) == B_OK;
+}
+
+
+void
+CardView::UpdateLayout()
+{
+	uint32 dirty = fLayoutDirty;
+	fLayoutDirty = 0;
+	if (dirty == 0)
+		return;
+
+	// Remember where the cards were, so that only those that moved are drawn
+	// again
+	std::vector<BRect> oldFrames;
+	for (size_t i = 0; i < fCards.size(); i++)
+		oldFrames.push_back(fCards[i].frame);
+
+	if ((dirty & kCardLayoutDirty) != 0) {
+		UpdatePreloadTarget();
+		LayoutCards();
+	}
+	if ((dirty & kReadingLayoutDirty) != 0)
+		LayoutReadingArea();
+	if ((dirty & kPreferredSizeDirty) != 0)
+		UpdatePreferredSize();
+
+	// The welcome message is centered in the view, so any change moves it
+	bool empty = fCards.empty();
+	if (empty || fLaidOutEmpty) {
+		fLaidOutEmpty = empty;
+		Invalidate();
+		return;
+	}
+
+	// The reading view draws itself, and the app_server redraws whatever it
+	// uncovers when it moves
+	for (size_t i = 0; i < fCards.size(); i++) {
+		if (fCards[i].frame == oldFrames[i])
+			continue;
+		fCompositeValid = false;
+		if (oldFrames[i].IsValid())
+			Invalidate(oldFrames[i]);
+		if (fCards[i].frame.IsValid())
+			Invalidate(fCards[i].frame);
+	}
+}
+
+
+void
+CardView::UpdatePreferredSize()
+{
+	// Tall enough for the view, the cards and the reading, whichever needs the
+	// most room
+	BRect bounds = Bounds();
+	float height = bounds.Height();
+	if (fCardAreaHeight > height)
+		height = fCardAreaHeight;
+	if (fReadingAreaHeight > height)
+		height = fReadingAreaHeight;
+
+	fPreferredSize = bounds;
+	fPreferredSize.bottom = bounds.top + height;
+}
+
+
+void
+CardView::InvalidateCards()
+{
+	for (size_t i = 0; i < fCards.size(); i++) {
+		if (fCards[i].frame.IsValid())
+			Invalidate(fCards[i].frame);
+	}
 }
 
 
@@ -445,6 +1005,15 @@ void
 CardView::SetSpread(SpreadType spread)
 {
 	fSpread = spread;
+	UpdatePreloadTarget();
+}
+
+
+void
+CardView::PreloadDeck(const std::vector<int32>& resourceIDs)
+{
+	fPreloader.Start(resourceIDs, Config::kDeckPreloadMaxBytes);
+	UpdatePreloadTarget();
 }
 
 
@@ -466,18 +1035,72 @@ CardView::SetFontSize(float size)
 	// Update the font size in the configuration
 	Config::SetFontSize(size);
 
-	// Refresh the layout to apply changes
+	// Paragraphs and labels measured in the old size are never looked up
+	// again
+	fLineBreaker.Clear();
+	fLabelCache.Clear();
+
+	// Refresh the layout to apply changes; every label is drawn in the new
+	// font, even where nothing moves
 	RefreshLayout();
+	fCompositeValid = false;
+	Invalidate();
 }
 
 
 void
 CardView::LayoutCards()
 {
+	// Spreads without cards to place need no room of their own
+	fCardAreaHeight = 0;
+
 	if (fSpread == THREE_CARD)
 		LayoutThreeCardSpread();
 	else if (fSpread == TREE_OF_LIFE)
 		LayoutTreeOfLifeSpread();
+
+	// Cards are only resampled when the size they are drawn at changes
+	if (!fCards.empty()
+		&& (fCardWidth != fScaledCardWidth || fCardHeight != fScaledCardHeight)) {
+		ScheduleScaling();
+	}
+}
+
+
+void
+CardView::CalculateCardSize(size_t cardCount, float readingAreaWidth, float& cardWidth,
+	float& cardHeight, float& labelHeight) const
+{
+	// Card area is on the right, after the reading area
+	float cardAreaWidth = Bounds().Width() - readingAreaWidth;
+
+	// Calculate available space for cards
+	float availableWidth = cardAreaWidth - (Config::kMarginX * 2);
+	labelHeight = fLabelHeight;
+
+	if (fSpread == TREE_OF_LIFE) {
+		cardWidth = availableWidth / Config::kTreeOfLifeCardWidthRatio;
+		cardHeight = cardWidth * Config::kCardAspectRatio;
+		return;
+	}
+
+	// The three card spread keeps all cards in one row
+	float cardSpacing = Config::kCardSpacing;
+	cardWidth = (availableWidth - (cardSpacing * (cardCount - 1.0f))) / cardCount;
+	cardHeight = cardWidth * Config::kCardAspectRatio; // 3.5/2.5 = 1.4
+
+	// Make label height responsive to card size
+	labelHeight = cardHeight * Config::kLabelHeightRatio; // 15% of card height for label
+	if (labelHeight < Config::kMinLabelHeight)
+		labelHeight = Config::kMinLabelHeight; // Minimum label height
+	if (labelHeight > Config::kMaxLabelHeight)
+		labelHeight = Config::kMaxLabelHeight; // Maximum label height
+
+	// Only keep minimum size limits to ensure cards remain visible
+	if (cardWidth < Config::kMinCardWidth)
+		cardWidth = Config::kMinCardWidth;
+	if (cardHeight < Config::kMinCardHeight)
+		cardHeight = Config::kMinCardHeight;
 }
 
 
@@ -497,28 +1120,9 @@ CardView::LayoutThreeCardSpread()
 
 	// Simplified responsive design - always use 3 columns for the spread
 	int cardsPerRow = fCards.size(); // Keep all cards in one row for the spread
-	float marginX = Config::kMarginX;
-
-	// Calculate available space for cards
-	float availableWidth = cardAreaWidth - (marginX * 2);
 	float cardSpacing = Config::kCardSpacing;
 
-	// Calculate card dimensions
-	fCardWidth = (availableWidth - (cardSpacing * (cardsPerRow - 1))) / cardsPerRow;
-	fCardHeight = fCardWidth * Config::kCardAspectRatio; // 3.5/2.5 = 1.4
-
-	// Make label height responsive to card size
-	fLabelHeight = fCardHeight * Config::kLabelHeightRatio; // 15% of card height for label
-	if (fLabelHeight < Config::kMinLabelHeight)
-		fLabelHeight = Config::kMinLabelHeight; // Minimum label height
-	if (fLabelHeight > Config::kMaxLabelHeight)
-		fLabelHeight = Config::kMaxLabelHeight; // Maximum label height
-
-	// Only keep minimum size limits to ensure cards remain visible
-	if (fCardWidth < Config::kMinCardWidth)
-		fCardWidth = Config::kMinCardWidth;
-	if (fCardHeight < Config::kMinCardHeight)
-		fCardHeight = Config::kMinCardHeight;
+	CalculateCardSize(cardsPerRow, fReadingAreaWidth, fCardWidth, fCardHeight, fLabelHeight);
 
 	float totalHeight = bounds.Height();
 
@@ -540,9 +1144,8 @@ CardView::LayoutThreeCardSpread()
 			yPosition + fCardHeight + fLabelHeight);
 	}
 
-	// Update preferred size - for three card spread, we ensure it's at least the bounds height
-	fPreferredSize = bounds;
-	fPreferredSize.bottom = totalHeight > bounds.Height() ? totalHeight : bounds.Height();
+	// The row is centered vertically, so it never needs more than the view
+	fCardAreaHeight = totalHeight;
 }
 
 
@@ -560,13 +1163,9 @@ CardView::LayoutTreeOfLifeSpread()
 	// Card area is now on the right, after the reading area
 	float cardAreaWidth = totalWidth - fReadingAreaWidth;
 
-	float marginX = Config::kMarginX;
 	float marginY = Config::kMarginY;
 
-	float availableWidth = cardAreaWidth - (marginX * 2);
-
-	fCardWidth = availableWidth / Config::kTreeOfLifeCardWidthRatio;
-	fCardHeight = fCardWidth * Config::kCardAspectRatio;
+	CalculateCardSize(fCards.size(), fReadingAreaWidth, fCardWidth, fCardHeight, fLabelHeight);
 
 	if (fCards.size() != 10)
 		return;
@@ -594,7 +1193,5 @@ CardView::LayoutTreeOfLifeSpread()
 		fCards[i].frame.Set(x, y, x + fCardWidth, y + fCardHeight);
 	}
 
-	// Update preferred size to accommodate all cards
-	fPreferredSize = bounds;
-	fPreferredSize.bottom = requiredHeight > bounds.Height() ? requiredHeight : bounds.Height();
+	fCardAreaHeight = requiredHeight;
 }
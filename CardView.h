@@ -1,15 +1,27 @@
 #pragma once
 
 #include "CardPresenter.h"
+#include "DeckPreloader.h"
+#include "LabelCache.h"
+#include "LineBreaker.h"
+#include "TaskExecutor.h"
 #include <String.h>
 #include <TextView.h> // Include BTextView
 #include <View.h>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 class BBitmap;
+class BRegion;
 
 struct CardDisplay {
-	BBitmap* image;
+	int32 resourceID;
+	std::shared_ptr<BBitmap> image; // Larger image to scale from, if one was needed
+	std::shared_ptr<BBitmap> scaled; // Card image at the size it is drawn at
+	std::shared_ptr<BBitmap> preview; // Enlarged until one of the above is ready
+	bool decoding;
+	bool composed; // Drawn into the offscreen spread as it is now
 	BRect frame;
 	BString displayName;
 };
@@ -31,21 +43,68 @@ public:
 	virtual BSize PreferredSize();
 
 	void DisplayCards(const std::vector<class CardInfo>& cards);
+	// Like DisplayCards, but uses already decoded bitmaps. Missing or NULL
+	// entries are taken from the BitmapCache; cards it holds neither in full
+	// nor scaled to their size are decoded in the background and drawn from
+	// their previews, or as placeholders, until then.
+	void DisplayCards(const std::vector<class CardInfo>& cards,
+		const std::vector<std::shared_ptr<BBitmap>>& bitmaps);
+
 	void DisplayReading(const BString& reading);
 
-	// Thread-safe method to update reading from background thread
-	void UpdateReading(const BString& reading);
+	// Thread-safe method to update reading from background thread. Readings
+	// from a generation other than the current one are ignored.
+	void UpdateReading(const BString& reading, uint32 generation);
+
+	// Thread-safe method to append streamed text to the reading. Calls made
+	// while an earlier append is still queued are merged into one UI update.
+	void AppendReading(const BString& delta, uint32 generation);
+
+	void SetReadingGeneration(uint32 generation);
 
 	void ClearCards();
 	void RefreshLayout();
 	void SetSpread(SpreadType spread);
 	void SetFontSize(float size);
 
+	// Starts decoding the given cards at low priority for later readings
+	void PreloadDeck(const std::vector<int32>& resourceIDs);
+
+	// How long drawing took since the previous report, for measuring redraw
+	// costs; starts counting anew
+	BString DrawingReport();
+
 private:
+	// Parts of the layout that are out of date
+	enum {
+		kCardLayoutDirty = 1 << 0,
+		kReadingLayoutDirty = 1 << 1,
+		kPreferredSizeDirty = 1 << 2
+	};
+
+	// Layout changes are collected and carried out once, before the next
+	// frame is drawn, however many resizes and updates arrive until then
+	void MarkLayoutDirty(uint32 parts);
+	void UpdateLayout();
+	void UpdatePreferredSize();
+	void InvalidateCards();
+	void DrawWelcome();
+	void DrawCards(const BRegion& updateRegion);
+	bool ComposeCards();
+	void DrawCard(BView* target, const CardDisplay& card, BRect cardFrame);
 	void LayoutCards();
 	void LayoutReadingArea();
 	void LayoutThreeCardSpread();
 	void LayoutTreeOfLifeSpread();
+	void CalculateCardSize(size_t cardCount, float readingAreaWidth, float& cardWidth,
+		float& cardHeight, float& labelHeight) const;
+	BRect ImageArea(BRect cardFrame, float labelHeight) const;
+	BRect ImageFrame(const CardDisplay& card, BRect cardFrame) const;
+	static void BoxSize(BRect imageArea, int32& width, int32& height);
+	void DecodeCard(size_t index, int32 boxWidth, int32 boxHeight);
+	void ScheduleScaling();
+	void ScaleCard(size_t index);
+	void UpdatePreloadTarget();
 	float CalculateTextHeightForTextView(BTextView* textView,
 		const BString& text); // Helper function
 
@@ -56,7 +115,57 @@ private:
 	float fCardHeight;
 	float fLabelHeight;
 	float fReadingAreaWidth;
-	float fReadingAreaHeight;
+	float fReadingAreaHeight; // Height the reading needs
+	float fCardAreaHeight; // Height the cards need
 	BRect fPreferredSize;
+	uint32 fLayoutDirty;
+	bool fLayoutQueued; // Whether a 'LAYT' message is on its way
+	bool fLaidOutEmpty; // Whether the last layout had no cards to place
+	int64 fFrameCount; // Frames drawn since the last DrawingReport()
+	int64 fCardsDrawn;
+	int64 fPixelsDrawn; // Area of the update regions drawn
+	bigtime_t fFrameTime;
+	bigtime_t fWorstFrameTime;
+
+	// The spread is drawn offscreen and shown with a single blit; cards are
+	// only drawn again when their image or layout changes
+	BBitmap* fComposite;
+	BView* fCompositeView; // Draws into fComposite, which owns it
+	BRect fCompositeFrame; // Where fComposite is shown in the view
+	bool fCompositeValid; // Whether anything but uncomposed cards is current
 	SpreadType fSpread;
+	LineBreaker fLineBreaker; // Wraps the reading to size it
+	LabelCache fLabelCache; // Card labels fitted to their cards
+
+	std::mutex fPendingLock;
+	BString fPendingReading; // Streamed text not yet shown, guarded by fPendingLock
+	uint32 fPendingGeneration; // Guarded by fPendingLock
+	bool fAppendQueued; // Guarded by fPendingLock
+	bool fReadingStreaming; // Whether fReading already holds streamed text
+	uint32 fReadingGeneration;
+
+	struct ScaledImage {
+		size_t index;
+		std::shared_ptr<BBitmap> source;
+		std::shared_ptr<BBitmap> scaled;
+		uint32 generation;
+	};
+
+	struct DecodedImage {
+		size_t index;
+		std::shared_ptr<BBitmap> bitmap;
+		bool fitsBox; // Decoded at the size it is drawn at, no scaling needed
+		uint32 generation;
+	};
+
+	std::mutex fDecodedLock;
+	std::vector<DecodedImage> fDecodedImages; // Guarded by fDecodedLock
+	TaskExecutor fDecoder; // Decodes the cards of a spread in parallel
+
+	float fScaledCardWidth; // Card size the scaled images were requested for
+	float fScaledCardHeight;
+	std::mutex fScaledLock;
+	std::vector<ScaledImage> fScaledImages; // Finished but not yet shown, guarded by fScaledLock
+	TaskExecutor fScaler; // Resamples card images off the window thread
+	DeckPreloader fPreloader;
 };
@@ -12,8 +12,14 @@
 
 
 BString Config::sAPIKey = "";
+BString Config::sAPIEndpoint = "";
 SpreadType Config::sSpread = THREE_CARD;
 bool Config::sLogReadings = false;
+bool Config::sStreamReadings = true;
+bool Config::sBypassReadingCache = false;
+bool Config::sPrefetchReadings = false;
+bool Config::sPreloadDeck = true;
+bool Config::sShowCardPreviews = true;
 float Config::sFontSize = 12.0f;
 
 // UI Constants
@@ -43,9 +49,27 @@ const int Config::kThreeCardSpreadCount = 3;
 const int Config::kTreeOfLifeSpreadCount = 10;
 
 // API Constants
+const char* Config::kDefaultAPIEndpoint = "https://api.deepseek.com/v1/chat/completions";
 const int Config::kAPIMaxTokens = 300; // Increased to allow for longer responses
 const double Config::kAPITemperature = 0.7;
-const long Config::kAPITimeout = 30L;
+const long Config::kAPITimeout = 30L; // Upper bound for a whole request, in seconds
+const long Config::kAPIResolveTimeout = 10L;
+const long Config::kAPIConnectTimeout = 10L;
+const long Config::kAPIHandshakeTimeout = 10L;
+const long Config::kAPIWriteTimeout = 10L;
+const long Config::kAPIReadTimeout = 20L; // Longest silence allowed while reading the response
+const long Config::kConnectionIdleTimeout = 60L; // Seconds an idle connection is kept warm
+const int Config::kMaxIdleConnectionsPerHost = 2;
+const int Config::kMaxRequestsPerConnection = 100;
+const int Config::kReadingWorkerCount = 3;
+const int Config::kReadingCacheMemoryEntries = 64;
+const off_t Config::kReadingCacheMaxDiskBytes = 1024 * 1024;
+const long Config::kReadingCacheTTL = 30L * 24 * 60 * 60; // Seconds a cached reading stays valid
+const size_t Config::kBitmapCacheMaxBytes = 64 * 1024 * 1024; // Decoded card images kept around
+const size_t Config::kDeckPreloadMaxBytes = 32 * 1024 * 1024; // Cards scaled at startup
+const off_t Config::kCardDiskCacheMaxBytes = 128 * 1024 * 1024; // Scaled cards kept on disk
+const int Config::kCardDecoderWorkerCount = 4; // Threads decoding the cards of a new spread
+const int Config::kCardScalerWorkerCount = 2; // Threads resampling cards to their drawn size
 
 // Main Window Constants
 const float Config::kMainWindowLeft = 100;
@@ -181,6 +205,105 @@ Config::GetLogReadings()
 }
 
 
+void
+Config::SetStreamReadings(bool streamReadings)
+{
+	sStreamReadings = streamReadings;
+	SaveSettingsToFile();
+}
+
+
+bool
+Config::GetStreamReadings()
+{
+	return sStreamReadings;
+}
+
+
+BString
+Config::GetAPIEndpoint()
+{
+	// The environment takes precedence, like it does for the API key
+	const char* envEndpoint = getenv("ACE_OF_WANDS_API_ENDPOINT");
+	if (envEndpoint != NULL && *envEndpoint != '\0')
+		return BString(envEndpoint);
+
+	if (!sAPIEndpoint.IsEmpty())
+		return sAPIEndpoint;
+
+	return BString(kDefaultAPIEndpoint);
+}
+
+
+void
+Config::SetAPIEndpoint(const BString& endpoint)
+{
+	sAPIEndpoint = endpoint;
+	sAPIEndpoint.Trim();
+	SaveSettingsToFile();
+}
+
+
+void
+Config::SetPrefetchReadings(bool prefetchReadings)
+{
+	sPrefetchReadings = prefetchReadings;
+	SaveSettingsToFile();
+}
+
+
+bool
+Config::GetPrefetchReadings()
+{
+	return sPrefetchReadings;
+}
+
+
+void
+Config::SetPreloadDeck(bool preloadDeck)
+{
+	sPreloadDeck = preloadDeck;
+	SaveSettingsToFile();
+}
+
+
+bool
+Config::GetPreloadDeck()
+{
+	return sPreloadDeck;
+}
+
+
+void
+Config::SetShowCardPreviews(bool showCardPreviews)
+{
+	sShowCardPreviews = showCardPreviews;
+	SaveSettingsToFile();
+}
+
+
+bool
+Config::GetShowCardPreviews()
+{
+	return sShowCardPreviews;
+}
+
+
+void
+Config::SetBypassReadingCache(bool bypass)
+{
+	sBypassReadingCache = bypass;
+	SaveSettingsToFile();
+}
+
+
+bool
+Config::GetBypassReadingCache()
+{
+	return sBypassReadingCache;
+}
+
+
 void
 Config::SetFontSize(float fontSize)
 {
@@ -216,6 +339,12 @@ Config::SaveSettingsToFile()
 	BMessage settings('AOWS'); // Ace of Wands Settings
 	settings.AddInt32("spread", static_cast<int32>(sSpread));
 	settings.AddBool("logReadings", sLogReadings);
+	settings.AddBool("streamReadings", sStreamReadings);
+	settings.AddBool("bypassReadingCache", sBypassReadingCache);
+	settings.AddBool("prefetchReadings", sPrefetchReadings);
+	settings.AddBool("preloadDeck", sPreloadDeck);
+	settings.AddBool("cardPreviews", sShowCardPreviews);
+	settings.AddString("apiEndpoint", sAPIEndpoint);
 	settings.AddFloat("fontSize", sFontSize);
 
 	// Save the message to file
@@ -253,6 +382,30 @@ Config::LoadSettingsFromFile()
 		if (settings.FindBool("logReadings", &logReadings) == B_OK)
 			sLogReadings = logReadings;
 
+		bool streamReadings;
+		if (settings.FindBool("streamReadings", &streamReadings) == B_OK)
+			sStreamReadings = streamReadings;
+
+		bool bypassReadingCache;
+		if (settings.FindBool("bypassReadingCache", &bypassReadingCache) == B_OK)
+			sBypassReadingCache = bypassReadingCache;
+
+		bool prefetchReadings;
+		if (settings.FindBool("prefetchReadings", &prefetchReadings) == B_OK)
+			sPrefetchReadings = prefetchReadings;
+
+		bool preloadDeck;
+		if (settings.FindBool("preloadDeck", &preloadDeck) == B_OK)
+			sPreloadDeck = preloadDeck;
+
+		bool showCardPreviews;
+		if (settings.FindBool("cardPreviews", &showCardPreviews) == B_OK)
+			sShowCardPreviews = showCardPreviews;
+
+		BString apiEndpoint;
+		if (settings.FindString("apiEndpoint", &apiEndpoint) == B_OK)
+			sAPIEndpoint = apiEndpoint;
+
 		float fontSize;
 		if (settings.FindFloat("fontSize", &fontSize) == B_OK)
 			sFontSize = fontSize;
@@ -10,12 +10,31 @@ public:
 	static void SetAPIKey(const BString& apiKey);
 	static BString LoadAPIKeyFromFile();
 
+	// URL of the chat completions endpoint, e.g. a local stand-in server
+	static BString GetAPIEndpoint();
+	static void SetAPIEndpoint(const BString& endpoint);
+
 	static void SetSpread(SpreadType spread);
 	static SpreadType GetSpread();
 
 	static void SetLogReadings(bool logReadings);
 	static bool GetLogReadings();
 
+	static void SetStreamReadings(bool streamReadings);
+	static bool GetStreamReadings();
+
+	static void SetPrefetchReadings(bool prefetchReadings);
+	static bool GetPrefetchReadings();
+
+	static void SetPreloadDeck(bool preloadDeck);
+	static bool GetPreloadDeck();
+
+	static void SetShowCardPreviews(bool showCardPreviews);
+	static bool GetShowCardPreviews();
+
+	static void SetBypassReadingCache(bool bypass);
+	static bool GetBypassReadingCache();
+
 	static void SetFontSize(float fontSize);
 	static float GetFontSize();
 
@@ -50,9 +69,27 @@ public:
 	static const int kTreeOfLifeSpreadCount;
 
 	// API Constants
+	static const char* kDefaultAPIEndpoint;
 	static const int kAPIMaxTokens;
 	static const double kAPITemperature;
 	static const long kAPITimeout;
+	static const long kAPIResolveTimeout;
+	static const long kAPIConnectTimeout;
+	static const long kAPIHandshakeTimeout;
+	static const long kAPIWriteTimeout;
+	static const long kAPIReadTimeout;
+	static const long kConnectionIdleTimeout;
+	static const int kMaxIdleConnectionsPerHost;
+	static const int kMaxRequestsPerConnection;
+	static const int kReadingWorkerCount;
+	static const int kReadingCacheMemoryEntries;
+	static const off_t kReadingCacheMaxDiskBytes;
+	static const long kReadingCacheTTL;
+	static const size_t kBitmapCacheMaxBytes;
+	static const size_t kDeckPreloadMaxBytes;
+	static const off_t kCardDiskCacheMaxBytes;
+	static const int kCardDecoderWorkerCount;
+	static const int kCardScalerWorkerCount;
 
 	// Main Window Constants
 	static const float kMainWindowLeft;
@@ -68,8 +105,14 @@ public:
 
 private:
 	static BString sAPIKey;
+	static BString sAPIEndpoint;
 	static SpreadType sSpread;
 	static bool sLogReadings;
+	static bool sStreamReadings;
+	static bool sBypassReadingCache;
+	static bool sPrefetchReadings;
+	static bool sPreloadDeck;
+	static bool sShowCardPreviews;
 	static float sFontSize;
 	static void SaveAPIKeyToFile(const BString& apiKey);
 };
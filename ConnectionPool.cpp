@@ -0,0 +1,231 @@
+#include "ConnectionPool.h"
+#include "Config.h"
+#include "TLSContext.h"
+
+#include <poll.h>
+
+
+PooledConnection::PooledConnection(const BString& host, const BString& port, bool secure,
+	std::shared_ptr<ssl::context> sslContext)
+	:
+	sslContext(sslContext),
+	ioContext(),
+	stream(ioContext, *sslContext),
+	host(host),
+	port(port),
+	secure(secure),
+	lastUsed(std::chrono::steady_clock::now()),
+	requestCount(0)
+{
+}
+
+
+ConnectionPool&
+ConnectionPool::Default()
+{
+	static ConnectionPool sPool;
+	return sPool;
+}
+
+
+ConnectionPool::ConnectionPool()
+{
+}
+
+
+ConnectionPool::~ConnectionPool()
+{
+	CloseIdle();
+}
+
+
+std::unique_ptr<PooledConnection>
+ConnectionPool::Acquire(const BString& host, const BString& port, bool secure,
+	RequestDeadline& deadline, bool* reused)
+{
+	if (reused != NULL)
+		*reused = false;
+
+	std::vector<std::unique_ptr<PooledConnection>> stale;
+	std::unique_ptr<PooledConnection> connection;
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		auto it = fIdle.find(KeyFor(host, port, secure));
+		if (it != fIdle.end()) {
+			auto now = std::chrono::steady_clock::now();
+			std::vector<std::unique_ptr<PooledConnection>>& idle = it->second;
+			// Most recently used connections are at the back and least likely
+			// to have been dropped by the server.
+			while (!idle.empty()) {
+				std::unique_ptr<PooledConnection> candidate = std::move(idle.back());
+				idle.pop_back();
+				if (!IsExpired(*candidate, now) && IsHealthy(*candidate)) {
+					connection = std::move(candidate);
+					break;
+				}
+				stale.push_back(std::move(candidate));
+			}
+		}
+	}
+
+	// Stale connections are closed without a TLS shutdown; the peer has either
+	// gone away already or will time us out on its side.
+	stale.clear();
+
+	if (connection) {
+		if (reused != NULL)
+			*reused = true;
+		return connection;
+	}
+
+	return Connect(host, port, secure, deadline);
+}
+
+
+void
+ConnectionPool::Release(std::unique_ptr<PooledConnection> connection)
+{
+	if (!connection)
+		return;
+
+	connection->lastUsed = std::chrono::steady_clock::now();
+	connection->requestCount++;
+	if (connection->requestCount >= Config::kMaxRequestsPerConnection)
+		return;
+
+	std::unique_ptr<PooledConnection> evicted;
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		std::vector<std::unique_ptr<PooledConnection>>& idle
+			= fIdle[KeyFor(connection->host, connection->port, connection->secure)];
+		if (idle.size() >= static_cast<size_t>(Config::kMaxIdleConnectionsPerHost)) {
+			evicted = std::move(idle.front());
+			idle.erase(idle.begin());
+		}
+		idle.push_back(std::move(connection));
+	}
+}
+
+
+void
+ConnectionPool::CloseIdle()
+{
+	std::map<std::string, std::vector<std::unique_ptr<PooledConnection>>> idle;
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		idle.swap(fIdle);
+	}
+
+	for (auto& entry : idle) {
+		for (auto& connection : entry.second) {
+			beast::error_code ec;
+			connection->stream.next_layer().shutdown(tcp::socket::shutdown_both, ec);
+			connection->stream.next_layer().close(ec);
+		}
+	}
+}
+
+
+std::unique_ptr<PooledConnection>
+ConnectionPool::Connect(const BString& host, const BString& port, bool secure,
+	RequestDeadline& deadline)
+{
+	std::unique_ptr<PooledConnection> connection
+		= std::make_unique<PooledConnection>(host, port, secure, TLSContext::Shared());
+	tcp::socket& socket = connection->stream.next_layer();
+	auto closeSocket = [&socket]() {
+		beast::error_code ignored;
+		socket.close(ignored);
+	};
+
+	// Resolve the hostname
+	tcp::resolver resolver(connection->ioContext);
+	tcp::resolver::results_type results;
+	beast::error_code ec = deadline.Run(connection->ioContext, kPhaseResolve,
+		[&](const RequestDeadline::Completion& done) {
+			resolver.async_resolve(host.String(), port.String(),
+				[&results, done](const beast::error_code& ec,
+					tcp::resolver::results_type resolved) {
+					results = resolved;
+					done(ec);
+				});
+		},
+		[&resolver]() { resolver.cancel(); });
+	if (ec)
+		throw beast::system_error{ec};
+
+	// Set SNI Hostname
+	if (secure && !SSL_set_tlsext_host_name(connection->stream.native_handle(), host.String())) {
+		beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
+		throw beast::system_error{ec};
+	}
+
+	// Connect to the server
+	ec = deadline.Run(connection->ioContext, kPhaseConnect,
+		[&](const RequestDeadline::Completion& done) {
+			net::async_connect(socket, results,
+				[done](const beast::error_code& ec, const tcp::endpoint&) { done(ec); });
+		},
+		closeSocket);
+	if (ec)
+		throw beast::system_error{ec};
+	socket.set_option(tcp::no_delay(true));
+
+	if (!secure)
+		return connection;
+
+	// Perform SSL handshake, resuming the last session for this host if we have one
+	TLSContext::PrepareSession(connection->stream.native_handle(), host);
+	ec = deadline.Run(connection->ioContext, kPhaseHandshake,
+		[&](const RequestDeadline::Completion& done) {
+			connection->stream.async_handshake(ssl::stream_base::client, done);
+		},
+		closeSocket);
+	if (ec)
+		throw beast::system_error{ec};
+	TLSContext::RecordHandshake(connection->stream.native_handle());
+
+	return connection;
+}
+
+
+bool
+ConnectionPool::IsHealthy(PooledConnection& connection) const
+{
+	tcp::socket& socket = connection.stream.next_layer();
+	if (!socket.is_open())
+		return false;
+
+	// An idle HTTP connection should have nothing to read. If the socket is
+	// readable the server has either closed it, reset it or sent a TLS
+	// close_notify, and in all of those cases the connection is unusable.
+	struct pollfd descriptor;
+	descriptor.fd = socket.native_handle();
+	descriptor.events = POLLIN;
+	descriptor.revents = 0;
+
+	int result = poll(&descriptor, 1, 0);
+	if (result < 0)
+		return false;
+
+	return (descriptor.revents & (POLLIN | POLLHUP | POLLERR)) == 0;
+}
+
+
+bool
+ConnectionPool::IsExpired(const PooledConnection& connection,
+	std::chrono::steady_clock::time_point now) const
+{
+	return now - connection.lastUsed > std::chrono::seconds(Config::kConnectionIdleTimeout);
+}
+
+
+std::string
+ConnectionPool::KeyFor(const BString& host, const BString& port, bool secure)
+{
+	std::string key = secure ? "https://" : "http://";
+	key += host.String();
+	key += ':';
+	key += port.String();
+	return key;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "RequestDeadline.h"
+
+#include <String.h>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast.hpp>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+
+// A single kept-alive connection. Each connection owns the io_context its
+// socket is bound to, so a worker thread can drive it synchronously without
+// sharing an event loop with other requests.
+struct PooledConnection {
+	PooledConnection(const BString& host, const BString& port, bool secure,
+		std::shared_ptr<ssl::context> sslContext);
+
+	// Calls operation with the TLS stream, or with the bare socket for a plain
+	// HTTP connection, so that callers can use either with the same code.
+	template<typename Operation>
+	void WithStream(Operation&& operation)
+	{
+		if (secure)
+			operation(stream);
+		else
+			operation(stream.next_layer());
+	}
+
+	std::shared_ptr<ssl::context> sslContext;
+	net::io_context ioContext;
+	ssl::stream<tcp::socket> stream; // Only the socket is used when not secure
+	BString host;
+	BString port;
+	bool secure;
+	std::chrono::steady_clock::time_point lastUsed;
+	int requestCount;
+};
+
+class ConnectionPool {
+public:
+	static ConnectionPool& Default();
+
+	// Returns a warm connection to host:port if a healthy one is idle, otherwise
+	// opens a new one within the limits of deadline. Without secure the
+	// connection speaks plain HTTP. reused is set to true when the connection
+	// came from the pool.
+	std::unique_ptr<PooledConnection> Acquire(const BString& host, const BString& port,
+		bool secure, RequestDeadline& deadline, bool* reused);
+
+	// Hands a connection back after a request that left it reusable.
+	void Release(std::unique_ptr<PooledConnection> connection);
+
+	void CloseIdle();
+
+private:
+	ConnectionPool();
+	~ConnectionPool();
+
+	std::unique_ptr<PooledConnection> Connect(const BString& host, const BString& port,
+		bool secure, RequestDeadline& deadline);
+	bool IsHealthy(PooledConnection& connection) const;
+	bool IsExpired(const PooledConnection& connection,
+		std::chrono::steady_clock::time_point now) const;
+	static std::string KeyFor(const BString& host, const BString& port, bool secure);
+
+	std::mutex fLock;
+	std::map<std::string, std::vector<std::unique_ptr<PooledConnection>>> fIdle;
+};
@@ -0,0 +1,170 @@
+#include "DeckPreloader.h"
+#include "BitmapCache.h"
+#include "ImageScaler.h"
+
+#include <Bitmap.h>
+#include <OS.h>
+
+#include <memory>
+
+
+DeckPreloader::DeckPreloader()
+	:
+	fMemoryCeiling(0),
+	fBoxWidth(0),
+	fBoxHeight(0),
+	fTargetGeneration(0),
+	fForegroundDecodes(0),
+	fQuitting(false)
+{
+}
+
+
+DeckPreloader::~DeckPreloader()
+{
+	Stop();
+}
+
+
+void
+DeckPreloader::Start(const std::vector<int32>& resourceIDs, size_t memoryCeiling)
+{
+	if (fThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		fResourceIDs = resourceIDs;
+		fMemoryCeiling = memoryCeiling;
+		fQuitting = false;
+	}
+	fThread = std::thread(&DeckPreloader::Run, this);
+}
+
+
+void
+DeckPreloader::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		fQuitting = true;
+	}
+	fCondition.notify_all();
+
+	if (fThread.joinable())
+		fThread.join();
+}
+
+
+void
+DeckPreloader::SetTargetSize(int32 boxWidth, int32 boxHeight)
+{
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		if (boxWidth == fBoxWidth && boxHeight == fBoxHeight)
+			return;
+
+		fBoxWidth = boxWidth;
+		fBoxHeight = boxHeight;
+		fTargetGeneration++;
+	}
+	fCondition.notify_all();
+}
+
+
+void
+DeckPreloader::BeginForegroundDecode()
+{
+	std::lock_guard<std::mutex> lock(fLock);
+	fForegroundDecodes++;
+}
+
+
+void
+DeckPreloader::EndForegroundDecode()
+{
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		fForegroundDecodes--;
+	}
+	fCondition.notify_all();
+}
+
+
+void
+DeckPreloader::Run()
+{
+	set_thread_priority(find_thread(NULL), B_LOW_PRIORITY);
+
+	uint32 generation = 0;
+	size_t next = 0;
+	size_t stored = 0;
+
+	while (true) {
+		int32 resourceID;
+		int32 boxWidth;
+		int32 boxHeight;
+		{
+			std::unique_lock<std::mutex> lock(fLock);
+			// Wait for a usable size, for the foreground to finish decoding,
+			// and, once the deck is done, for the size to change
+			fCondition.wait(lock, [&]() {
+				return fQuitting
+					|| (fBoxWidth > 0 && fBoxHeight > 0 && fForegroundDecodes == 0
+						&& (generation != fTargetGeneration
+							|| (next < fResourceIDs.size() && stored < fMemoryCeiling)));
+			});
+			if (fQuitting)
+				return;
+
+			if (generation != fTargetGeneration) {
+				// Start over for the new size; what was stored for the old
+				// one is left for the cache to evict
+				generation = fTargetGeneration;
+				next = 0;
+				stored = 0;
+			}
+			if (next >= fResourceIDs.size() || stored >= fMemoryCeiling)
+				continue;
+
+			resourceID = fResourceIDs[next++];
+			boxWidth = fBoxWidth;
+			boxHeight = fBoxHeight;
+		}
+
+		BitmapCache& cache = BitmapCache::Default();
+		if (cache.Contains(resourceID, boxWidth, boxHeight))
+			continue;
+
+		// An earlier launch may have left the card on disk at this size; it
+		// counts against the ceiling like a decoded one
+		std::shared_ptr<BBitmap> scaled
+			= BitmapCache::LookupStored(resourceID, boxWidth, boxHeight);
+		bool restored = scaled != NULL;
+		if (!restored)
+			scaled.reset(BitmapCache::Decode(resourceID, boxWidth, boxHeight));
+		if (!scaled)
+			continue;
+
+		// Images from the card pack come in fixed sizes and still need scaling
+		BRect bounds = scaled->Bounds();
+		int32 width;
+		int32 height;
+		ImageScaler::FitSize(bounds.IntegerWidth() + 1, bounds.IntegerHeight() + 1, boxWidth,
+			boxHeight, width, height);
+		if (width != bounds.IntegerWidth() + 1 || height != bounds.IntegerHeight() + 1)
+			scaled.reset(ImageScaler::ScaleBitmap(scaled.get(), width, height));
+		if (!scaled)
+			continue;
+
+		size_t size = scaled->BitsLength();
+		if (stored + size > fMemoryCeiling) {
+			// The ceiling is reached; wait for a new size
+			stored = fMemoryCeiling;
+			continue;
+		}
+
+		stored += size;
+		cache.Insert(resourceID, boxWidth, boxHeight, scaled, !restored);
+	}
+}
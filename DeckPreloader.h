@@ -0,0 +1,43 @@
+#pragma once
+
+#include <SupportDefs.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Decodes the card images of the deck at low priority after startup and
+// stores them in the BitmapCache scaled to the size cards are drawn at, so
+// that the first readings do not have to decode them. Stops once the images
+// it stored reach a memory ceiling, and waits while cards of a reading are
+// being decoded in the foreground.
+class DeckPreloader {
+public:
+	DeckPreloader();
+	~DeckPreloader();
+
+	void Start(const std::vector<int32>& resourceIDs, size_t memoryCeiling);
+	void Stop();
+
+	// Size of the box images are fitted into. Changing it makes the preloader
+	// go over the deck again for the new size.
+	void SetTargetSize(int32 boxWidth, int32 boxHeight);
+
+	// Pause preloading while the window waits for images of its own.
+	void BeginForegroundDecode();
+	void EndForegroundDecode();
+
+private:
+	void Run();
+
+	std::thread fThread;
+	std::mutex fLock;
+	std::condition_variable fCondition;
+	std::vector<int32> fResourceIDs;
+	size_t fMemoryCeiling;
+	int32 fBoxWidth;
+	int32 fBoxHeight;
+	uint32 fTargetGeneration; // Bumped whenever the box size changes
+	int32 fForegroundDecodes;
+	bool fQuitting;
+};
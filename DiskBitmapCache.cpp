@@ -0,0 +1,365 @@
+#include "DiskBitmapCache.h"
+#include "BitmapCache.h"
+#include "Config.h"
+
+#include <Bitmap.h>
+#include <Directory.h>
+#include <Entry.h>
+#include <File.h>
+#include <FindDirectory.h>
+#include <OS.h>
+#include <String.h>
+
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+
+static const uint32 kEntryMagic = 'AOWB';
+static const uint32 kEntryVersion = 1;
+// Pixels start on a page boundary of the mapped file
+static const off_t kPixelOffset = B_PAGE_SIZE;
+
+
+struct EntryHeader {
+	uint32 magic;
+	uint32 version;
+	int32 width;
+	int32 height;
+	int32 bytesPerRow;
+	uint32 colorSpace;
+	uint64 fingerprint;
+};
+
+
+struct CacheFile {
+	BEntry entry;
+	off_t size;
+	time_t modified;
+};
+
+
+// Lists the regular files in a directory
+static off_t
+ListFiles(BDirectory& directory, std::vector<CacheFile>& files)
+{
+	off_t total = 0;
+	BEntry entry;
+	directory.Rewind();
+	while (directory.GetNextEntry(&entry) == B_OK) {
+		struct stat st;
+		if (entry.GetStat(&st) != B_OK || !S_ISREG(st.st_mode))
+			continue;
+
+		CacheFile file = {entry, st.st_size, st.st_mtime};
+		files.push_back(file);
+		total += st.st_size;
+	}
+	return total;
+}
+
+
+DiskBitmapCache&
+DiskBitmapCache::Default()
+{
+	static DiskBitmapCache sCache;
+	return sCache;
+}
+
+
+DiskBitmapCache::DiskBitmapCache()
+	:
+	fInitialized(false),
+	fUsable(false),
+	fQuitting(false),
+	fDiskUsage(0)
+{
+}
+
+
+DiskBitmapCache::~DiskBitmapCache()
+{
+	// Without a Shutdown() first, images still waiting are dropped; they are
+	// written again the next time they are scaled
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		fPending.clear();
+	}
+	Shutdown();
+}
+
+
+std::shared_ptr<BBitmap>
+DiskBitmapCache::Lookup(int32 resourceID, int32 boxWidth, int32 boxHeight)
+{
+	BPath path;
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		if (!InitLocked())
+			return std::shared_ptr<BBitmap>();
+
+		path = EntryPath(resourceID, boxWidth, boxHeight);
+	}
+
+	int fd = open(path.Path(), O_RDONLY);
+	if (fd < 0)
+		return std::shared_ptr<BBitmap>();
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < kPixelOffset) {
+		close(fd);
+		return std::shared_ptr<BBitmap>();
+	}
+
+	size_t size = st.st_size;
+	void* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return std::shared_ptr<BBitmap>();
+
+	const EntryHeader* header = static_cast<const EntryHeader*>(base);
+	color_space space = static_cast<color_space>(header->colorSpace);
+	if (header->magic != kEntryMagic || header->version != kEntryVersion
+		|| header->fingerprint != BitmapCache::ResourceFingerprint()
+		|| (space != B_RGB32 && space != B_RGBA32)
+		|| header->width <= 0 || header->height <= 0
+		|| header->bytesPerRow < header->width * 4
+		|| static_cast<uint64>(header->bytesPerRow) * header->height > size - kPixelOffset) {
+		munmap(base, size);
+		return std::shared_ptr<BBitmap>();
+	}
+
+	// The area behind a private mapping cannot be cloned by app_server, so
+	// the pixels are copied into a bitmap of its own
+	BBitmap* bitmap = new BBitmap(BRect(0, 0, header->width - 1, header->height - 1), space);
+	status_t status = bitmap->InitCheck();
+	if (status != B_OK) {
+		static bool sReported = false;
+		if (!sReported) {
+			fprintf(stderr, "Card image cache: cannot create a %" B_PRId32 "x%" B_PRId32
+				" bitmap: %s\n", header->width, header->height, strerror(status));
+			sReported = true;
+		}
+		delete bitmap;
+		munmap(base, size);
+		return std::shared_ptr<BBitmap>();
+	}
+
+	const uint8* source = static_cast<const uint8*>(base) + kPixelOffset;
+	uint8* target = static_cast<uint8*>(bitmap->Bits());
+	size_t rowLength = static_cast<size_t>(header->width) * 4;
+	for (int32 y = 0; y < header->height; y++) {
+		memcpy(target, source, rowLength);
+		source += header->bytesPerRow;
+		target += bitmap->BytesPerRow();
+	}
+	munmap(base, size);
+
+	// Trim() deletes the files modified longest ago, so a hit counts as a
+	// modification to keep the images in use
+	utimes(path.Path(), NULL);
+
+	return std::shared_ptr<BBitmap>(bitmap);
+}
+
+
+void
+DiskBitmapCache::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		fQuitting = true;
+	}
+	fCondition.notify_all();
+
+	if (fThread.joinable())
+		fThread.join();
+}
+
+
+void
+DiskBitmapCache::Store(int32 resourceID, int32 boxWidth, int32 boxHeight,
+	const std::shared_ptr<BBitmap>& bitmap)
+{
+	if (!bitmap || boxWidth <= 0 || boxHeight <= 0)
+		return;
+
+	color_space space = bitmap->ColorSpace();
+	if (space != B_RGB32 && space != B_RGBA32)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		if (!InitLocked() || fQuitting)
+			return;
+
+		Pending pending = {boxWidth, boxHeight, bitmap};
+		fPending[resourceID] = pending;
+	}
+	fCondition.notify_all();
+}
+
+
+bool
+DiskBitmapCache::InitLocked()
+{
+	if (fInitialized)
+		return fUsable;
+	fInitialized = true;
+
+	BPath path;
+	if (find_directory(B_USER_CACHE_DIRECTORY, &path) != B_OK)
+		return false;
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016" B_PRIx64, BitmapCache::ResourceFingerprint());
+	if (path.Append("AceOfWands/cards") != B_OK || path.Append(name) != B_OK
+		|| create_directory(path.Path(), 0755) != B_OK) {
+		return false;
+	}
+
+	fDirectory = path;
+	fUsable = true;
+	fThread = std::thread(&DiskBitmapCache::Run, this);
+	return true;
+}
+
+
+BPath
+DiskBitmapCache::EntryPath(int32 resourceID, int32 boxWidth, int32 boxHeight) const
+{
+	BString name;
+	name << resourceID << "-" << boxWidth << "x" << boxHeight;
+
+	BPath path(fDirectory);
+	path.Append(name.String());
+	return path;
+}
+
+
+bool
+DiskBitmapCache::Write(int32 resourceID, const Pending& pending)
+{
+	BPath path = EntryPath(resourceID, pending.boxWidth, pending.boxHeight);
+	if (BEntry(path.Path()).Exists())
+		return false;
+
+	BRect bounds = pending.bitmap->Bounds();
+	EntryHeader header = {};
+	header.magic = kEntryMagic;
+	header.version = kEntryVersion;
+	header.width = bounds.IntegerWidth() + 1;
+	header.height = bounds.IntegerHeight() + 1;
+	header.bytesPerRow = header.width * 4;
+	header.colorSpace = pending.bitmap->ColorSpace();
+	header.fingerprint = BitmapCache::ResourceFingerprint();
+
+	// Written under a temporary name and renamed when complete, so that a
+	// reader never maps half a file
+	BString temporary(path.Path());
+	temporary << ".tmp";
+	BFile file(temporary.String(), B_WRITE_ONLY | B_CREATE_FILE | B_ERASE_FILE);
+	if (file.InitCheck() != B_OK)
+		return false;
+
+	bool written = file.WriteAt(0, &header, sizeof(header)) == sizeof(header);
+	const uint8* bits = static_cast<const uint8*>(pending.bitmap->Bits());
+	for (int32 y = 0; written && y < header.height; y++) {
+		off_t position = kPixelOffset + static_cast<off_t>(y) * header.bytesPerRow;
+		written = file.WriteAt(position, bits + static_cast<size_t>(y)
+			* pending.bitmap->BytesPerRow(), header.bytesPerRow) == header.bytesPerRow;
+	}
+	file.Unset();
+
+	if (!written || rename(temporary.String(), path.Path()) != 0) {
+		unlink(temporary.String());
+		return false;
+	}
+
+	fDiskUsage += kPixelOffset + static_cast<off_t>(header.bytesPerRow) * header.height;
+	return true;
+}
+
+
+void
+DiskBitmapCache::RemoveStaleDirectories()
+{
+	// Images of other builds of the application can never be used again
+	BPath parentPath;
+	BDirectory parent;
+	if (fDirectory.GetParent(&parentPath) != B_OK || parent.SetTo(parentPath.Path()) != B_OK)
+		return;
+
+	BEntry entry;
+	while (parent.GetNextEntry(&entry) == B_OK) {
+		char name[B_FILE_NAME_LENGTH];
+		if (!entry.IsDirectory() || entry.GetName(name) != B_OK
+			|| strcmp(name, fDirectory.Leaf()) == 0) {
+			continue;
+		}
+
+		BDirectory stale(&entry);
+		std::vector<CacheFile> files;
+		ListFiles(stale, files);
+		for (size_t i = 0; i < files.size(); i++)
+			files[i].entry.Remove();
+		entry.Remove();
+	}
+}
+
+
+void
+DiskBitmapCache::Trim()
+{
+	BDirectory directory(fDirectory.Path());
+	std::vector<CacheFile> files;
+	fDiskUsage = ListFiles(directory, files);
+	if (fDiskUsage <= Config::kCardDiskCacheMaxBytes)
+		return;
+
+	// Delete the least recently used images until a quarter of the budget is free again, so
+	// that this does not run again after every write
+	std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) {
+		return a.modified < b.modified;
+	});
+	for (size_t i = 0; i < files.size()
+			&& fDiskUsage > Config::kCardDiskCacheMaxBytes / 4 * 3; i++) {
+		if (files[i].entry.Remove() == B_OK)
+			fDiskUsage -= files[i].size;
+	}
+}
+
+
+void
+DiskBitmapCache::Run()
+{
+	set_thread_priority(find_thread(NULL), B_LOW_PRIORITY);
+
+	RemoveStaleDirectories();
+	Trim();
+
+	while (true) {
+		int32 resourceID;
+		Pending pending;
+		{
+			std::unique_lock<std::mutex> lock(fLock);
+			fCondition.wait(lock, [&]() { return fQuitting || !fPending.empty(); });
+			if (fPending.empty())
+				return;
+
+			auto it = fPending.begin();
+			resourceID = it->first;
+			pending = it->second;
+			fPending.erase(it);
+		}
+
+		if (Write(resourceID, pending) && fDiskUsage > Config::kCardDiskCacheMaxBytes)
+			Trim();
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Path.h>
+#include <SupportDefs.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class BBitmap;
+
+// Card images scaled for display, kept in the user cache directory between
+// launches. Each image is one file named after its resource ID and box size,
+// in a directory named after BitmapCache::ResourceFingerprint(), so images
+// from another build of the application are never used. Files are written by
+// a low priority thread and copied out of a mapping when read; the least
+// recently used ones are deleted once the directory grows past its budget.
+class DiskBitmapCache {
+public:
+	static DiskBitmapCache& Default();
+
+	// Reads a stored image, or returns NULL if there is none for the box.
+	std::shared_ptr<BBitmap> Lookup(int32 resourceID, int32 boxWidth, int32 boxHeight);
+	// Queues an image to be written. Only the last image queued for a card
+	// is kept while the writer is busy, so that resizing the window does not
+	// store every size it passes through.
+	void Store(int32 resourceID, int32 boxWidth, int32 boxHeight,
+		const std::shared_ptr<BBitmap>& bitmap);
+	// Writes the images still queued and stops the writer. Nothing is stored
+	// afterwards.
+	void Shutdown();
+
+private:
+	struct Pending {
+		int32 boxWidth;
+		int32 boxHeight;
+		std::shared_ptr<BBitmap> bitmap;
+	};
+
+	DiskBitmapCache();
+	~DiskBitmapCache();
+
+	bool InitLocked();
+	BPath EntryPath(int32 resourceID, int32 boxWidth, int32 boxHeight) const;
+	bool Write(int32 resourceID, const Pending& pending);
+	void RemoveStaleDirectories();
+	void Trim();
+	void Run();
+
+	std::mutex fLock;
+	std::condition_variable fCondition;
+	std::thread fThread;
+	bool fInitialized;
+	bool fUsable;
+	bool fQuitting;
+	BPath fDirectory;
+	std::map<int32, Pending> fPending; // By resource ID
+	off_t fDiskUsage; // Only touched by the writer thread
+};
@@ -1,86 +1,409 @@
 #include "HTTPClient.h"
+#include "CancellationToken.h"
+
+#include <arpa/inet.h>
+#include <atomic>
 #include <iostream>
 
 
 HTTPClient::HTTPClient()
-	:
-	mIOContext(std::make_unique<net::io_context>()),
-	mSSLContext(std::make_unique<ssl::context>(ssl::context::tlsv12_client))
 {
-	mSSLContext->set_default_verify_paths();
-	mSSLContext->set_verify_mode(ssl::verify_peer);
 }
 
 HTTPClient::~HTTPClient() = default;
 
 
-BString
-HTTPClient::Post(const BString& url, const BString& jsonData, const BString& authHeader)
+static std::atomic<uint64> sTimeouts[kPhaseCount];
+static std::atomic<uint64> sCancellations(0);
+
+
+// A Beast body that hands every decoded piece of the body straight from the
+// read buffer to a callback, instead of collecting it into a string.
+struct SinkBody {
+	typedef const HTTPClient::BodyCallback* value_type;
+
+	class reader {
+	public:
+		template<bool isRequest, class Fields>
+		reader(http::header<isRequest, Fields>&, value_type& sink)
+			:
+			fSink(sink)
+		{
+		}
+
+		void init(const boost::optional<std::uint64_t>&, beast::error_code& ec) { ec = {}; }
+
+		template<class ConstBufferSequence>
+		size_t put(const ConstBufferSequence& buffers, beast::error_code& ec)
+		{
+			size_t length = 0;
+			for (auto it = net::buffer_sequence_begin(buffers);
+				it != net::buffer_sequence_end(buffers); ++it) {
+				net::const_buffer buffer = *it;
+				(*fSink)(static_cast<const char*>(buffer.data()), buffer.size());
+				length += buffer.size();
+			}
+			ec = {};
+			return length;
+		}
+
+		void finish(beast::error_code& ec) { ec = {}; }
+
+	private:
+		value_type& fSink;
+	};
+};
+
+
+HTTPResult
+HTTPClient::Post(const BString& url, const BString& jsonData, const BString& authHeader,
+	const BodyCallback& onBody, CancellationToken* cancelToken)
+{
+	Endpoint endpoint;
+	HTTPResult result;
+	if (!ParseEndpoint(url, endpoint, result.error))
+		return result;
+
+	return PerformRequest(endpoint, jsonData, authHeader, NULL, &onBody, cancelToken);
+}
+
+
+HTTPResult
+HTTPClient::PostStreaming(const BString& url, const BString& jsonData, const BString& authHeader,
+	const EventCallback& onEvent, CancellationToken* cancelToken)
+{
+	Endpoint endpoint;
+	HTTPResult result;
+	if (!ParseEndpoint(url, endpoint, result.error))
+		return result;
+
+	return PerformRequest(endpoint, jsonData, authHeader, &onEvent, NULL, cancelToken);
+}
+
+
+uint64
+HTTPClient::TimeoutCount(RequestPhase phase)
+{
+	if (phase < 0 || phase >= kPhaseCount)
+		return 0;
+	return sTimeouts[phase].load();
+}
+
+
+uint64
+HTTPClient::CancelCount()
+{
+	return sCancellations.load();
+}
+
+
+bool
+HTTPClient::ParseEndpoint(const BString& url, Endpoint& endpoint, BString& error)
+{
+	// scheme://host[:port][/path], with IPv6 hosts in brackets
+	int32 hostStart;
+	if (url.StartsWith("https://")) {
+		endpoint.secure = true;
+		endpoint.port = "443";
+		hostStart = 8;
+	} else if (url.StartsWith("http://")) {
+		endpoint.secure = false;
+		endpoint.port = "80";
+		hostStart = 7;
+	} else {
+		error = "Unsupported API endpoint: ";
+		error << url;
+		return false;
+	}
+
+	int32 pathStart = url.FindFirst('/', hostStart);
+	if (pathStart < 0)
+		pathStart = url.Length();
+
+	BString authority;
+	url.CopyInto(authority, hostStart, pathStart - hostStart);
+	int32 portStart = authority.FindLast(':');
+	if (authority.StartsWith("[")) {
+		int32 bracketEnd = authority.FindFirst(']');
+		if (bracketEnd < 0) {
+			error = "Malformed API endpoint: ";
+			error << url;
+			return false;
+		}
+		authority.CopyInto(endpoint.host, 1, bracketEnd - 1);
+		if (portStart < bracketEnd)
+			portStart = -1;
+	} else if (portStart >= 0) {
+		authority.CopyInto(endpoint.host, 0, portStart);
+	} else {
+		endpoint.host = authority;
+	}
+	if (portStart >= 0)
+		authority.CopyInto(endpoint.port, portStart + 1, authority.Length() - portStart - 1);
+
+	if (pathStart < url.Length())
+		url.CopyInto(endpoint.target, pathStart, url.Length() - pathStart);
+	else
+		endpoint.target = "/";
+
+	if (endpoint.host.IsEmpty() || endpoint.port.IsEmpty()) {
+		error = "Malformed API endpoint: ";
+		error << url;
+		return false;
+	}
+
+	// The API key travels in the clear without TLS, so plain HTTP is only
+	// good for a server on this machine, such as the stand-in server.
+	if (!endpoint.secure && !IsLoopbackHost(endpoint.host)) {
+		error = "Plain HTTP is only allowed for localhost: ";
+		error << url;
+		return false;
+	}
+
+	return true;
+}
+
+
+bool
+HTTPClient::IsLoopbackHost(const BString& host)
 {
-	try {
-		// Hardcoded values for the fixed DeepSeek API URL
-		BString host = "api.deepseek.com";
-		BString target = "/v1/chat/completions";
-
-		return PerformHTTPSRequest(host, target, jsonData, authHeader);
-	} catch (const std::exception& e) {
-		BString errorMsg = "HTTP Request Error: ";
-		errorMsg += e.what();
-		return errorMsg;
+	// Only names and literals that cannot lead off this machine; a prefix test
+	// would also let a host such as 127.example.com through
+	if (host.ICompare("localhost") == 0 || host == "::1" || host == "[::1]")
+		return true;
+
+	struct in_addr address;
+	if (inet_pton(AF_INET, host.String(), &address) != 1)
+		return false;
+	return (ntohl(address.s_addr) >> 24) == 127;
+}
+
+
+HTTPResult
+HTTPClient::PerformRequest(const Endpoint& endpoint, const BString& jsonData,
+	const BString& authHeader, const EventCallback* onEvent, const BodyCallback* onBody,
+	CancellationToken* cancelToken)
+{
+	BString hostField = endpoint.host;
+	if (endpoint.host.FindFirst(':') >= 0)
+		hostField.Prepend("[").Append("]");
+	if (endpoint.port != (endpoint.secure ? "443" : "80"))
+		hostField << ":" << endpoint.port;
+
+	// Set up HTTP POST request
+	http::request<http::string_body> req{http::verb::post, endpoint.target.String(), 11};
+	req.set(http::field::host, hostField.String());
+	req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+	req.set(http::field::content_type, "application/json");
+	req.set(http::field::authorization, authHeader.String());
+	req.set(http::field::accept, onEvent != NULL ? "text/event-stream" : "application/json");
+	req.keep_alive(true);
+	req.body() = jsonData.String();
+	req.prepare_payload();
+
+	HTTPResult result;
+	RequestDeadline deadline(cancelToken);
+
+	// A pooled connection may have been closed by the server since it was
+	// checked, so a failure on a reused connection is retried once on a fresh
+	// one, as long as nothing of the response has been seen yet.
+	for (int attempt = 0;; attempt++) {
+		bool reused = false;
+		bool responseStarted = false;
+		std::unique_ptr<PooledConnection> connection;
+		try {
+			connection = ConnectionPool::Default().Acquire(endpoint.host, endpoint.port,
+				endpoint.secure, deadline, &reused);
+
+			PooledConnection& pooled = *connection;
+			auto closeSocket = [&pooled]() {
+				beast::error_code ignored;
+				pooled.stream.next_layer().close(ignored);
+			};
+
+			// Send the HTTP request
+			beast::error_code ec = deadline.Run(connection->ioContext, kPhaseWrite,
+				[&](const RequestDeadline::Completion& done) {
+					pooled.WithStream([&](auto& stream) {
+						http::async_write(stream, req,
+							[done](const beast::error_code& ec, size_t) { done(ec); });
+					});
+				},
+				closeSocket);
+			if (ec)
+				throw beast::system_error{ec};
+
+			// Receive the HTTP response
+			beast::flat_buffer buffer;
+			bool keepAlive;
+			if (onEvent != NULL) {
+				http::response_parser<http::buffer_body> parser;
+				ec = deadline.Run(connection->ioContext, kPhaseRead,
+					[&](const RequestDeadline::Completion& done) {
+						pooled.WithStream([&](auto& stream) {
+							http::async_read_header(stream, buffer, parser,
+								[done](const beast::error_code& ec, size_t) { done(ec); });
+						});
+					},
+					closeSocket);
+				if (ec)
+					throw beast::system_error{ec};
+				responseStarted = true;
+				result.body = ReadEventStream(*connection, deadline, buffer, parser, *onEvent);
+				keepAlive = parser.keep_alive();
+			} else {
+				// The header is read on its own so that nothing reaches onBody
+				// before a retry on a fresh connection is ruled out
+				http::response_parser<SinkBody> parser;
+				parser.get().body() = onBody;
+				ec = deadline.Run(connection->ioContext, kPhaseRead,
+					[&](const RequestDeadline::Completion& done) {
+						pooled.WithStream([&](auto& stream) {
+							http::async_read_header(stream, buffer, parser,
+								[done](const beast::error_code& ec, size_t) { done(ec); });
+						});
+					},
+					closeSocket);
+				if (ec)
+					throw beast::system_error{ec};
+				responseStarted = true;
+				ec = deadline.Run(connection->ioContext, kPhaseRead,
+					[&](const RequestDeadline::Completion& done) {
+						pooled.WithStream([&](auto& stream) {
+							http::async_read(stream, buffer, parser,
+								[done](const beast::error_code& ec, size_t) { done(ec); });
+						});
+					},
+					closeSocket);
+				if (ec)
+					throw beast::system_error{ec};
+				keepAlive = parser.keep_alive();
+			}
+
+			if (keepAlive) {
+				ConnectionPool::Default().Release(std::move(connection));
+			} else if (connection->secure) {
+				beast::error_code ignored;
+				connection->stream.shutdown(ignored);
+			}
+
+			result.status = HTTPResult::kCompleted;
+			return result;
+		} catch (const std::exception& e) {
+			if (deadline.TimedOut()) {
+				result.status = HTTPResult::kTimedOut;
+				result.phase = deadline.ExpiredPhase();
+				sTimeouts[result.phase]++;
+				std::cout << "HTTP request timed out while "
+						  << RequestDeadline::PhaseName(result.phase) << std::endl;
+				return result;
+			}
+
+			if (deadline.Cancelled()) {
+				result.status = HTTPResult::kCancelled;
+				sCancellations++;
+				return result;
+			}
+
+			const beast::system_error* systemError = dynamic_cast<const beast::system_error*>(&e);
+			if (systemError != NULL && reused && attempt == 0 && !responseStarted
+				&& IsStaleConnectionError(systemError->code())) {
+				continue;
+			}
+
+			std::cout << "HTTP request failed: " << e.what() << std::endl;
+			result.status = HTTPResult::kFailed;
+			result.error = "HTTP Request Error: ";
+			result.error += e.what();
+			return result;
+		}
 	}
 }
 
 
 BString
-HTTPClient::PerformHTTPSRequest(const BString& host, const BString& target, const BString& jsonData,
-	const BString& authHeader)
+HTTPClient::ReadEventStream(PooledConnection& connection, RequestDeadline& deadline,
+	beast::flat_buffer& buffer, http::response_parser<http::buffer_body>& parser,
+	const EventCallback& onEvent)
 {
-	try {
-		// Resolve the hostname
-		tcp::resolver resolver(*mIOContext);
-		auto const results = resolver.resolve(host.String(), "443");
-
-		// Create SSL stream
-		ssl::stream<tcp::socket> stream(*mIOContext, *mSSLContext);
-
-		// Set SNI Hostname
-		if (!SSL_set_tlsext_host_name(stream.native_handle(), host.String())) {
-			beast::error_code ec{static_cast<int>(::ERR_get_error()),
-				net::error::get_ssl_category()};
+	bool isEventStream
+		= parser.get()[http::field::content_type].starts_with("text/event-stream");
+
+	BString body;
+	std::string pending;
+	std::string eventData;
+	char chunk[4096];
+
+	while (!parser.is_done()) {
+		parser.get().body().data = chunk;
+		parser.get().body().size = sizeof(chunk);
+
+		// read_some returns as soon as the socket yields anything, so events are
+		// dispatched as they arrive rather than when the chunk buffer fills up.
+		// The read phase timeout therefore bounds the gap between two chunks.
+		beast::error_code ec = deadline.Run(connection.ioContext, kPhaseRead,
+			[&](const RequestDeadline::Completion& done) {
+				connection.WithStream([&](auto& stream) {
+					http::async_read_some(stream, buffer, parser,
+						[done](const beast::error_code& ec, size_t) { done(ec); });
+				});
+			},
+			[&connection]() {
+				beast::error_code ignored;
+				connection.stream.next_layer().close(ignored);
+			});
+		if (ec == http::error::need_buffer)
+			ec = {};
+		if (ec)
 			throw beast::system_error{ec};
+
+		size_t length = sizeof(chunk) - parser.get().body().size;
+		if (!isEventStream) {
+			body.Append(chunk, length);
+			continue;
 		}
 
-		// Connect to the server
-		net::connect(stream.next_layer(), results.begin(), results.end());
+		pending.append(chunk, length);
 
-		// Perform SSL handshake
-		stream.handshake(ssl::stream_base::client);
+		// Split into lines; a blank line ends an event, "data:" lines make up
+		// its payload and lines starting with ':' are keep-alive comments.
+		size_t lineStart = 0;
+		size_t lineEnd;
+		while ((lineEnd = pending.find('\n', lineStart)) != std::string::npos) {
+			size_t lineLength = lineEnd - lineStart;
+			if (lineLength > 0 && pending[lineEnd - 1] == '\r')
+				lineLength--;
 
-		// Set up HTTP POST request
-		http::request<http::string_body> req{http::verb::post, target.String(), 11};
-		req.set(http::field::host, host.String());
-		req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-		req.set(http::field::content_type, "application/json");
-		req.set(http::field::authorization, authHeader.String());
-		req.set(http::field::accept, "application/json");
-		req.body() = jsonData.String();
-		req.prepare_payload();
+			if (lineLength == 0) {
+				if (!eventData.empty()) {
+					onEvent(BString(eventData.c_str(), eventData.size()));
+					eventData.clear();
+				}
+			} else if (pending.compare(lineStart, 5, "data:") == 0) {
+				size_t valueStart = lineStart + 5;
+				if (valueStart < lineStart + lineLength && pending[valueStart] == ' ')
+					valueStart++;
+				if (!eventData.empty())
+					eventData += '\n';
+				eventData.append(pending, valueStart, lineStart + lineLength - valueStart);
+			}
 
-		// Send the HTTP request
-		http::write(stream, req);
+			lineStart = lineEnd + 1;
+		}
+		pending.erase(0, lineStart);
+	}
 
-		// Receive the HTTP response
-		beast::flat_buffer buffer;
-		http::response<http::string_body> res;
-		http::read(stream, buffer, res);
+	if (!eventData.empty())
+		onEvent(BString(eventData.c_str(), eventData.size()));
 
+	return body;
+}
 
-		beast::error_code ec;
-		stream.shutdown(ec);
 
-		return BString(res.body().c_str());
-	} catch (const std::exception& e) {
-		std::cout << "HTTPS request failed: " << e.what() << std::endl;
-		throw;
-	}
+bool
+HTTPClient::IsStaleConnectionError(const beast::error_code& ec)
+{
+	return ec == http::error::end_of_stream || ec == net::error::eof
+		|| ec == net::error::connection_reset || ec == net::error::connection_aborted
+		|| ec == net::error::broken_pipe || ec == net::ssl::error::stream_truncated;
 }
@@ -1,29 +1,73 @@
 #pragma once
 
+#include "ConnectionPool.h"
+#include "RequestDeadline.h"
 #include <String.h>
-#include <boost/asio.hpp>
-#include <boost/asio/ssl.hpp>
-#include <boost/beast.hpp>
+#include <functional>
 #include <memory>
 #include <string>
 
-namespace beast = boost::beast;
-namespace http = beast::http;
-namespace net = boost::asio;
-namespace ssl = net::ssl;
-using tcp = net::ip::tcp;
+class CancellationToken;
+
+struct HTTPResult {
+	enum Status {
+		kCompleted, // A response was received
+		kTimedOut, // phase ran past its deadline
+		kCancelled, // The request was cancelled through its token
+		kFailed // Any other error; error describes it
+	};
+
+	HTTPResult() : status(kFailed), phase(kPhaseResolve) {}
+
+	Status status;
+	RequestPhase phase;
+	BString body;
+	BString error;
+};
 
 class HTTPClient {
 public:
+	// Receives the data of each server-sent event as it arrives.
+	typedef std::function<void(const BString& eventData)> EventCallback;
+	// Receives each piece of a response body as it is parsed, straight from
+	// the read buffer.
+	typedef std::function<void(const char* data, size_t length)> BodyCallback;
+
 	HTTPClient();
 	~HTTPClient();
 
-	BString Post(const BString& url, const BString& jsonData, const BString& authHeader);
+	// Posts jsonData and hands the response body to onBody while it is being
+	// read, without collecting it first; the result body is left empty.
+	HTTPResult Post(const BString& url, const BString& jsonData, const BString& authHeader,
+		const BodyCallback& onBody, CancellationToken* cancelToken = NULL);
+
+	// Posts jsonData asking for a stream. When the server answers with
+	// text/event-stream the events are handed to onEvent while the body is
+	// still arriving and the result body is left empty. Any other response
+	// body is returned as a whole.
+	HTTPResult PostStreaming(const BString& url, const BString& jsonData,
+		const BString& authHeader, const EventCallback& onEvent,
+		CancellationToken* cancelToken = NULL);
+
+	static uint64 TimeoutCount(RequestPhase phase);
+	static uint64 CancelCount();
 
 private:
-	std::unique_ptr<net::io_context> mIOContext;
-	std::unique_ptr<ssl::context> mSSLContext;
+	struct Endpoint {
+		bool secure;
+		BString host;
+		BString port;
+		BString target;
+	};
+
+	static bool ParseEndpoint(const BString& url, Endpoint& endpoint, BString& error);
+	static bool IsLoopbackHost(const BString& host);
 
-	BString PerformHTTPSRequest(const BString& host, const BString& target, const BString& jsonData,
-		const BString& authHeader);
+	HTTPResult PerformRequest(const Endpoint& endpoint, const BString& jsonData,
+		const BString& authHeader, const EventCallback* onEvent, const BodyCallback* onBody,
+		CancellationToken* cancelToken);
+	static BString ReadEventStream(PooledConnection& connection, RequestDeadline& deadline,
+		beast::flat_buffer& buffer, http::response_parser<http::buffer_body>& parser,
+		const EventCallback& onEvent);
+	static bool IsStaleConnectionError(const beast::error_code& ec);
 };
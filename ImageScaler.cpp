@@ -0,0 +1,502 @@
+#include "ImageScaler.h"
+
+#include <Bitmap.h>
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define IMAGE_SCALER_X86 1
+#include <immintrin.h>
+#endif
+
+
+static const int32 kWeightBits = 14;
+static const int32 kWeightOne = 1 << kWeightBits;
+
+
+static inline uint8
+ClampChannel(int32 sum)
+{
+	sum = (sum + kWeightOne / 2) >> kWeightBits;
+	return static_cast<uint8>(std::min<int32>(std::max<int32>(sum, 0), 255));
+}
+
+
+// The kernels below filter one row of target pixels. Horizontal kernels take
+// count[x] source pixels starting at first[x] for every target pixel x;
+// vertical kernels take count source rows starting at row first.
+
+
+static void
+ScaleRowScalar(const uint8* in, uint8* out, int32 targetWidth, const int32* first,
+	const int32* count, const int16* weights, int32 stride)
+{
+	for (int32 x = 0; x < targetWidth; x++, weights += stride) {
+		const uint8* pixel = in + first[x] * 4;
+		int32 sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+		for (int32 k = 0; k < count[x]; k++, pixel += 4) {
+			sum0 += weights[k] * pixel[0];
+			sum1 += weights[k] * pixel[1];
+			sum2 += weights[k] * pixel[2];
+			sum3 += weights[k] * pixel[3];
+		}
+		out[x * 4 + 0] = ClampChannel(sum0);
+		out[x * 4 + 1] = ClampChannel(sum1);
+		out[x * 4 + 2] = ClampChannel(sum2);
+		out[x * 4 + 3] = ClampChannel(sum3);
+	}
+}
+
+
+static void
+ScaleColumnScalar(const uint8* source, int32 sourceBytesPerRow, int32 first, int32 count,
+	const int16* weights, int32 offset, int32 rowBytes, int32* sums, uint8* out)
+{
+	int32 length = rowBytes - offset;
+	std::fill(sums, sums + length, 0);
+
+	// Walk whole source rows so that memory is read sequentially
+	for (int32 k = 0; k < count; k++) {
+		const uint8* in = source + static_cast<size_t>(first + k) * sourceBytesPerRow + offset;
+		int32 weight = weights[k];
+		for (int32 i = 0; i < length; i++)
+			sums[i] += weight * in[i];
+	}
+
+	for (int32 i = 0; i < length; i++)
+		out[offset + i] = ClampChannel(sums[i]);
+}
+
+
+#ifdef IMAGE_SCALER_X86
+
+// Two weights side by side, as _mm_madd_epi16() multiplies them with
+// interleaved pixel pairs
+static inline int32
+WeightPair(int16 first, int16 second)
+{
+	return static_cast<int32>(static_cast<uint16>(first)
+		| static_cast<uint32>(static_cast<uint16>(second)) << 16);
+}
+
+
+// Rounds 32-bit sums of weighted channels back to bytes the way
+// ClampChannel() does
+__attribute__((target("sse2"))) static inline __m128i
+PackSSE2(__m128i sum0, __m128i sum1, __m128i sum2, __m128i sum3)
+{
+	const __m128i half = _mm_set1_epi32(kWeightOne / 2);
+	sum0 = _mm_srai_epi32(_mm_add_epi32(sum0, half), kWeightBits);
+	sum1 = _mm_srai_epi32(_mm_add_epi32(sum1, half), kWeightBits);
+	sum2 = _mm_srai_epi32(_mm_add_epi32(sum2, half), kWeightBits);
+	sum3 = _mm_srai_epi32(_mm_add_epi32(sum3, half), kWeightBits);
+	return _mm_packus_epi16(_mm_packs_epi32(sum0, sum1), _mm_packs_epi32(sum2, sum3));
+}
+
+
+// Adds the pixels from index k on to the four channel sums in sum, two at a
+// time
+__attribute__((target("sse2"))) static inline __m128i
+AccumulatePixelsSSE2(__m128i sum, const uint8* pixel, const int16* weights, int32 k,
+	int32 count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	for (; k + 1 < count; k += 2) {
+		// B0 G0 R0 A0 B1 G1 R1 A1 becomes B0 B1 G0 G1 R0 R1 A0 A1
+		__m128i p = _mm_unpacklo_epi8(
+			_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixel + k * 4)), zero);
+		p = _mm_unpacklo_epi16(p, _mm_unpackhi_epi64(p, p));
+		sum = _mm_add_epi32(sum,
+			_mm_madd_epi16(p, _mm_set1_epi32(WeightPair(weights[k], weights[k + 1]))));
+	}
+	if (k < count) {
+		int32 value;
+		memcpy(&value, pixel + k * 4, sizeof(value));
+		__m128i p = _mm_unpacklo_epi8(_mm_cvtsi32_si128(value), zero);
+		p = _mm_unpacklo_epi16(p, zero);
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(p, _mm_set1_epi32(WeightPair(weights[k], 0))));
+	}
+	return sum;
+}
+
+
+__attribute__((target("sse2"))) static void
+ScaleRowSSE2(const uint8* in, uint8* out, int32 targetWidth, const int32* first,
+	const int32* count, const int16* weights, int32 stride)
+{
+	for (int32 x = 0; x < targetWidth; x++, weights += stride) {
+		__m128i sum = AccumulatePixelsSSE2(_mm_setzero_si128(), in + first[x] * 4, weights, 0,
+			count[x]);
+		__m128i result = PackSSE2(sum, sum, sum, sum);
+		int32 value = _mm_cvtsi128_si32(result);
+		memcpy(out + x * 4, &value, sizeof(value));
+	}
+}
+
+
+__attribute__((target("avx2"))) static void
+ScaleRowAVX2(const uint8* in, uint8* out, int32 targetWidth, const int32* first,
+	const int32* count, const int16* weights, int32 stride)
+{
+	// Within each 128-bit lane, B0 G0 R0 A0 B1 G1 R1 A1 becomes
+	// B0 B1 G0 G1 R0 R1 A0 A1
+	const __m256i interleave = _mm256_setr_epi8(
+		0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+		0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+
+	for (int32 x = 0; x < targetWidth; x++, weights += stride) {
+		const uint8* pixel = in + first[x] * 4;
+		__m256i wide = _mm256_setzero_si256();
+		int32 k = 0;
+		for (; k + 3 < count[x]; k += 4) {
+			__m256i p = _mm256_cvtepu8_epi16(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixel + k * 4)));
+			p = _mm256_shuffle_epi8(p, interleave);
+			int32 low = WeightPair(weights[k], weights[k + 1]);
+			int32 high = WeightPair(weights[k + 2], weights[k + 3]);
+			wide = _mm256_add_epi32(wide,
+				_mm256_madd_epi16(p, _mm256_setr_epi32(low, low, low, low, high, high, high,
+					high)));
+		}
+
+		__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(wide),
+			_mm256_extracti128_si256(wide, 1));
+		sum = AccumulatePixelsSSE2(sum, pixel, weights, k, count[x]);
+		__m128i result = PackSSE2(sum, sum, sum, sum);
+		int32 value = _mm_cvtsi128_si32(result);
+		memcpy(out + x * 4, &value, sizeof(value));
+	}
+}
+
+
+// Filters 16 bytes of a row starting at offset
+__attribute__((target("sse2"))) static inline void
+ScaleColumnChunkSSE2(const uint8* source, int32 sourceBytesPerRow, int32 first, int32 count,
+	const int16* weights, int32 offset, uint8* out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+
+	// Rows are taken in pairs so that each byte and its neighbour below are
+	// multiplied and added in one step; an odd last row pairs with itself
+	// at weight 0
+	for (int32 k = 0; k < count; k += 2) {
+		const uint8* rowA = source + static_cast<size_t>(first + k) * sourceBytesPerRow;
+		const uint8* rowB = k + 1 < count ? rowA + sourceBytesPerRow : rowA;
+		__m128i weight = _mm_set1_epi32(
+			WeightPair(weights[k], k + 1 < count ? weights[k + 1] : 0));
+
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowA + offset));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowB + offset));
+		__m128i low = _mm_unpacklo_epi8(a, b);
+		__m128i high = _mm_unpackhi_epi8(a, b);
+		sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), weight));
+		sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), weight));
+		sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), weight));
+		sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), weight));
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset),
+		PackSSE2(sum0, sum1, sum2, sum3));
+}
+
+
+__attribute__((target("sse2"))) static void
+ScaleColumnSSE2(const uint8* source, int32 sourceBytesPerRow, int32 first, int32 count,
+	const int16* weights, int32 rowBytes, int32* sums, uint8* out)
+{
+	int32 offset = 0;
+	for (; offset + 16 <= rowBytes; offset += 16) {
+		ScaleColumnChunkSSE2(source, sourceBytesPerRow, first, count, weights, offset,
+			out);
+	}
+	if (offset < rowBytes) {
+		ScaleColumnScalar(source, sourceBytesPerRow, first, count, weights, offset,
+			rowBytes, sums, out);
+	}
+}
+
+
+__attribute__((target("avx2"))) static void
+ScaleColumnAVX2(const uint8* source, int32 sourceBytesPerRow, int32 first, int32 count,
+	const int16* weights, int32 rowBytes, int32* sums, uint8* out)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i half = _mm256_set1_epi32(kWeightOne / 2);
+
+	int32 offset = 0;
+	for (; offset + 32 <= rowBytes; offset += 32) {
+		__m256i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+		for (int32 k = 0; k < count; k += 2) {
+			const uint8* rowA = source + static_cast<size_t>(first + k) * sourceBytesPerRow;
+			const uint8* rowB = k + 1 < count ? rowA + sourceBytesPerRow : rowA;
+			__m256i weight = _mm256_set1_epi32(
+				WeightPair(weights[k], k + 1 < count ? weights[k + 1] : 0));
+
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rowA + offset));
+			__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rowB + offset));
+			__m256i low = _mm256_unpacklo_epi8(a, b);
+			__m256i high = _mm256_unpackhi_epi8(a, b);
+			sum0 = _mm256_add_epi32(sum0,
+				_mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), weight));
+			sum1 = _mm256_add_epi32(sum1,
+				_mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), weight));
+			sum2 = _mm256_add_epi32(sum2,
+				_mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), weight));
+			sum3 = _mm256_add_epi32(sum3,
+				_mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), weight));
+		}
+
+		// The unpacks above and the packs here both work within 128-bit
+		// lanes, so the bytes come out in their original order
+		sum0 = _mm256_srai_epi32(_mm256_add_epi32(sum0, half), kWeightBits);
+		sum1 = _mm256_srai_epi32(_mm256_add_epi32(sum1, half), kWeightBits);
+		sum2 = _mm256_srai_epi32(_mm256_add_epi32(sum2, half), kWeightBits);
+		sum3 = _mm256_srai_epi32(_mm256_add_epi32(sum3, half), kWeightBits);
+		__m256i result = _mm256_packus_epi16(_mm256_packs_epi32(sum0, sum1),
+			_mm256_packs_epi32(sum2, sum3));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + offset), result);
+	}
+
+	if (offset + 16 <= rowBytes) {
+		ScaleColumnChunkSSE2(source, sourceBytesPerRow, first, count, weights, offset,
+			out);
+		offset += 16;
+	}
+	if (offset < rowBytes) {
+		ScaleColumnScalar(source, sourceBytesPerRow, first, count, weights, offset,
+			rowBytes, sums, out);
+	}
+}
+
+#endif // IMAGE_SCALER_X86
+
+
+ImageScaler::ImageScaler(int32 sourceWidth, int32 sourceHeight, int32 targetWidth,
+	int32 targetHeight)
+	:
+	fSourceWidth(sourceWidth),
+	fSourceHeight(sourceHeight),
+	fTargetWidth(targetWidth),
+	fTargetHeight(targetHeight),
+	fKernel(BestKernel())
+{
+	fHorizontal.Build(sourceWidth, targetWidth);
+	fVertical.Build(sourceHeight, targetHeight);
+	fIntermediate.resize(static_cast<size_t>(targetWidth) * 4 * sourceHeight);
+}
+
+
+void
+ImageScaler::SetKernel(Kernel kernel)
+{
+	fKernel = IsSupported(kernel) ? kernel : BestKernel();
+}
+
+
+ImageScaler::Kernel
+ImageScaler::BestKernel()
+{
+	static const Kernel sBest = []() {
+		if (IsSupported(kAVX2Kernel))
+			return kAVX2Kernel;
+		if (IsSupported(kSSE2Kernel))
+			return kSSE2Kernel;
+		return kScalarKernel;
+	}();
+	return sBest;
+}
+
+
+bool
+ImageScaler::IsSupported(Kernel kernel)
+{
+	switch (kernel) {
+		case kScalarKernel:
+			return true;
+#ifdef IMAGE_SCALER_X86
+		case kSSE2Kernel:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+		case kAVX2Kernel:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+
+const char*
+ImageScaler::KernelName(Kernel kernel)
+{
+	switch (kernel) {
+		case kScalarKernel:
+			return "scalar";
+		case kSSE2Kernel:
+			return "SSE2";
+		case kAVX2Kernel:
+			return "AVX2";
+	}
+	return "unknown";
+}
+
+
+void
+ImageScaler::Scale(const uint8* source, int32 sourceBytesPerRow, uint8* target,
+	int32 targetBytesPerRow)
+{
+	ScaleRows(source, sourceBytesPerRow, fSourceHeight, fIntermediate.data(),
+		fTargetWidth * 4);
+	ScaleColumns(fIntermediate.data(), fTargetWidth * 4, target, targetBytesPerRow);
+}
+
+
+BBitmap*
+ImageScaler::ScaleBitmap(const BBitmap* source, int32 width, int32 height)
+{
+	if (source == NULL || width <= 0 || height <= 0)
+		return NULL;
+
+	color_space space = source->ColorSpace();
+	if (space != B_RGB32 && space != B_RGBA32)
+		return NULL;
+
+	BRect bounds = source->Bounds();
+	int32 sourceWidth = bounds.IntegerWidth() + 1;
+	int32 sourceHeight = bounds.IntegerHeight() + 1;
+
+	BBitmap* scaled = new BBitmap(BRect(0, 0, width - 1, height - 1), space);
+	if (scaled->InitCheck() != B_OK) {
+		delete scaled;
+		return NULL;
+	}
+
+	ImageScaler scaler(sourceWidth, sourceHeight, width, height);
+	scaler.Scale(static_cast<const uint8*>(source->Bits()), source->BytesPerRow(),
+		static_cast<uint8*>(scaled->Bits()), scaled->BytesPerRow());
+	return scaled;
+}
+
+
+void
+ImageScaler::FitSize(int32 sourceWidth, int32 sourceHeight, int32 boxWidth, int32 boxHeight,
+	int32& width, int32& height)
+{
+	if (static_cast<int64>(boxWidth) * sourceHeight
+		<= static_cast<int64>(boxHeight) * sourceWidth) {
+		width = boxWidth;
+		height = static_cast<int32>(
+			(static_cast<int64>(sourceHeight) * boxWidth + sourceWidth / 2) / sourceWidth);
+	} else {
+		height = boxHeight;
+		width = static_cast<int32>(
+			(static_cast<int64>(sourceWidth) * boxHeight + sourceHeight / 2) / sourceHeight);
+	}
+	width = std::max<int32>(1, std::min(width, boxWidth));
+	height = std::max<int32>(1, std::min(height, boxHeight));
+}
+
+
+void
+ImageScaler::Filter::Build(int32 sourceSize, int32 targetSize)
+{
+	// When shrinking, the kernel is widened to cover every source pixel that
+	// falls under a target pixel; when enlarging this is plain bilinear.
+	double scale = static_cast<double>(sourceSize) / targetSize;
+	double support = std::max(1.0, scale);
+
+	stride = static_cast<int32>(ceil(support)) * 2 + 1;
+	first.resize(targetSize);
+	count.resize(targetSize);
+	weights.assign(static_cast<size_t>(targetSize) * stride, 0);
+
+	std::vector<double> raw(stride);
+	for (int32 i = 0; i < targetSize; i++) {
+		double center = (i + 0.5) * scale;
+		int32 low = std::max<int32>(0, static_cast<int32>(floor(center - support)));
+		int32 high = std::min<int32>(sourceSize, static_cast<int32>(ceil(center + support)));
+		high = std::min(high, low + stride);
+
+		double total = 0;
+		int32 used = 0;
+		for (int32 x = low; x < high; x++) {
+			double weight = 1.0 - fabs((x + 0.5 - center) / support);
+			raw[used++] = std::max(0.0, weight);
+			total += raw[used - 1];
+		}
+
+		// Normalize to fixed point and give the rounding error to the largest
+		// weight, so flat areas keep their exact colour
+		int16* row = &weights[static_cast<size_t>(i) * stride];
+		int32 sum = 0;
+		int32 largest = 0;
+		for (int32 k = 0; k < used; k++) {
+			row[k] = total > 0 ? static_cast<int16>(lround(raw[k] / total * kWeightOne)) : 0;
+			sum += row[k];
+			if (row[k] > row[largest])
+				largest = k;
+		}
+		if (used > 0)
+			row[largest] += kWeightOne - sum;
+
+		first[i] = low;
+		count[i] = used;
+	}
+}
+
+
+void
+ImageScaler::ScaleRows(const uint8* source, int32 sourceBytesPerRow, int32 rows,
+	uint8* target, int32 targetBytesPerRow) const
+{
+	void (*scaleRow)(const uint8*, uint8*, int32, const int32*, const int32*, const int16*,
+		int32) = ScaleRowScalar;
+#ifdef IMAGE_SCALER_X86
+	if (fKernel == kAVX2Kernel)
+		scaleRow = ScaleRowAVX2;
+	else if (fKernel == kSSE2Kernel)
+		scaleRow = ScaleRowSSE2;
+#endif
+
+	for (int32 y = 0; y < rows; y++) {
+		scaleRow(source + static_cast<size_t>(y) * sourceBytesPerRow,
+			target + static_cast<size_t>(y) * targetBytesPerRow, fTargetWidth,
+			fHorizontal.first.data(), fHorizontal.count.data(), fHorizontal.weights.data(),
+			fHorizontal.stride);
+	}
+}
+
+
+void
+ImageScaler::ScaleColumns(const uint8* source, int32 sourceBytesPerRow, uint8* target,
+	int32 targetBytesPerRow) const
+{
+	int32 rowBytes = fTargetWidth * 4;
+	std::vector<int32> sums(rowBytes);
+
+	for (int32 y = 0; y < fTargetHeight; y++) {
+		const int16* weights = &fVertical.weights[static_cast<size_t>(y) * fVertical.stride];
+		uint8* out = target + static_cast<size_t>(y) * targetBytesPerRow;
+
+		switch (fKernel) {
+#ifdef IMAGE_SCALER_X86
+			case kAVX2Kernel:
+				ScaleColumnAVX2(source, sourceBytesPerRow, fVertical.first[y],
+					fVertical.count[y], weights, rowBytes, sums.data(), out);
+				break;
+			case kSSE2Kernel:
+				ScaleColumnSSE2(source, sourceBytesPerRow, fVertical.first[y],
+					fVertical.count[y], weights, rowBytes, sums.data(), out);
+				break;
+#endif
+			default:
+				ScaleColumnScalar(source, sourceBytesPerRow, fVertical.first[y],
+					fVertical.count[y], weights, 0, rowBytes, sums.data(), out);
+				break;
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <SupportDefs.h>
+#include <vector>
+
+class BBitmap;
+
+// Resamples 32-bit images with a triangle filter whose support grows with the
+// reduction factor, so that downscaling averages every source pixel instead
+// of skipping some the way plain bilinear sampling does. Works on B_RGB32 and
+// B_RGBA32 data; channels are filtered independently.
+//
+// The filter runs in SSE2 or AVX2 where the CPU has them. All kernels give
+// exactly the same result.
+class ImageScaler {
+public:
+	enum Kernel {
+		kScalarKernel,
+		kSSE2Kernel,
+		kAVX2Kernel
+	};
+
+	ImageScaler(int32 sourceWidth, int32 sourceHeight, int32 targetWidth, int32 targetHeight);
+
+	// Kernels default to the best one available; unsupported ones are
+	// replaced by it.
+	void SetKernel(Kernel kernel);
+	Kernel GetKernel() const { return fKernel; }
+
+	static Kernel BestKernel();
+	static bool IsSupported(Kernel kernel);
+	static const char* KernelName(Kernel kernel);
+
+	void Scale(const uint8* source, int32 sourceBytesPerRow, uint8* target,
+		int32 targetBytesPerRow);
+
+	// Returns a new B_RGBA32 bitmap of the given size, or NULL if the source
+	// is not a 32-bit bitmap.
+	static BBitmap* ScaleBitmap(const BBitmap* source, int32 width, int32 height);
+
+	// The largest size with the aspect ratio of the source that fits into a
+	// box; the result always fills the box along at least one side.
+	static void FitSize(int32 sourceWidth, int32 sourceHeight, int32 boxWidth, int32 boxHeight,
+		int32& width, int32& height);
+
+private:
+	// Weights of the source pixels that make up each target pixel along one
+	// axis, in 14-bit fixed point. Weights never exceed 1 << 14, so they fit
+	// into the 16-bit lanes of the SIMD kernels.
+	struct Filter {
+		void Build(int32 sourceSize, int32 targetSize);
+
+		std::vector<int32> first; // First source pixel of each target pixel
+		std::vector<int32> count; // Number of source pixels used
+		std::vector<int16> weights; // stride entries per target pixel
+		int32 stride;
+	};
+
+	void ScaleRows(const uint8* source, int32 sourceBytesPerRow, int32 rows, uint8* target,
+		int32 targetBytesPerRow) const;
+	void ScaleColumns(const uint8* source, int32 sourceBytesPerRow, uint8* target,
+		int32 targetBytesPerRow) const;
+
+	int32 fSourceWidth;
+	int32 fSourceHeight;
+	int32 fTargetWidth;
+	int32 fTargetHeight;
+	Kernel fKernel;
+	Filter fHorizontal;
+	Filter fVertical;
+	std::vector<uint8> fIntermediate; // Horizontally scaled rows
+};
@@ -1,145 +1,484 @@
 #include "JSONParser.h"
 #include "Config.h"
+
+#include <boost/json/basic_parser_impl.hpp>
+#include <algorithm>
 #include <iostream>
+#include <string.h>
 
 
-BString
-JSONParser::ParseAPIResponse(const BString& jsonResponse)
+static const size_t kMaxEchoedBytes = 1024;
+
+
+CompletionReader::CompletionReader()
+	:
+	fParser(json::parse_options()),
+	fHandler(fParser.handler()),
+	fFailed(false)
+{
+}
+
+
+CompletionReader::~CompletionReader()
+{
+}
+
+
+void
+CompletionReader::Reset()
+{
+	fParser.reset();
+	fHandler.Reset();
+	fEcho.clear();
+	fParseError = "";
+	fFailed = false;
+}
+
+
+bool
+CompletionReader::Feed(const char* data, size_t length)
+{
+	if (fFailed)
+		return false;
+
+	if (fEcho.size() < kMaxEchoedBytes)
+		fEcho.append(data, std::min(length, kMaxEchoedBytes - fEcho.size()));
+
+	json::error_code ec;
+	size_t consumed = 0;
+	if (!fParser.done())
+		consumed = fParser.write_some(true, data, length, ec);
+	if (!ec && consumed < length) {
+		// The parser stops after the document; only whitespace may follow
+		for (size_t i = consumed; i < length && !ec; i++) {
+			if (strchr(" \t\r\n", data[i]) == NULL)
+				ec = json::error::extra_data;
+		}
+	}
+
+	if (ec) {
+		fFailed = true;
+		fParseError = ec.message().c_str();
+		return false;
+	}
+
+	return true;
+}
+
+
+bool
+CompletionReader::Finish()
 {
-	try {
-		json::value jsonValue = json::parse(jsonResponse.String());
+	if (fFailed)
+		return false;
+
+	json::error_code ec;
+	if (!fParser.done())
+		fParser.write_some(false, "", 0, ec);
+
+	if (!ec && !fParser.done())
+		ec = json::error::incomplete;
 
-		if (HasError(jsonValue))
-			return ExtractErrorMessage(jsonValue);
+	if (ec) {
+		fFailed = true;
+		fParseError = ec.message().c_str();
+		return false;
+	}
 
-		BString content = ExtractContent(jsonValue);
-		if (content.IsEmpty())
-			return BString("Error: Unexpected API response format.");
+	return true;
+}
 
-		if (IsResponseTruncated(jsonValue))
-			content += " [Response truncated due to token limit]";
 
-		return content;
-	} catch (const std::exception& e) {
+BString
+CompletionReader::Reading(bool* succeeded) const
+{
+	if (succeeded != NULL)
+		*succeeded = false;
+
+	if (fFailed) {
 		BString errorMsg = "Error: Failed to parse API response: ";
-		errorMsg += e.what();
+		errorMsg += fParseError;
 		errorMsg += "\nResponse: ";
-		errorMsg += jsonResponse.String();
+		errorMsg.Append(fEcho.data(), fEcho.size());
 		return errorMsg;
 	}
+
+	if (HasError())
+		return ErrorMessage();
+
+	if (fHandler.content.empty())
+		return BString("Error: Unexpected API response format.");
+
+	// The one copy of the reading that leaves the reader
+	BString content(fHandler.content.data(), fHandler.content.size());
+	if (IsTruncated())
+		content += " [Response truncated due to token limit]";
+
+	if (succeeded != NULL)
+		*succeeded = true;
+	return content;
 }
 
 
 BString
-JSONParser::BuildPayload(const BString& prompt, int maxTokens, float temperature)
+CompletionReader::ErrorMessage() const
 {
-	json::object payload;
+	if (!fHandler.errorIsObject)
+		return BString("API Error: Unknown error format");
 
-	payload["model"] = "deepseek-chat";
+	if (!fHandler.hasErrorMessage)
+		return BString("API Error: Unknown API error");
 
-	json::array messages;
-	json::object message;
-	message["role"] = "user";
-	message["content"] = prompt.String();
-	messages.push_back(message);
+	BString errorMsg = "API Error: ";
+	errorMsg.Append(fHandler.errorMessage.data(), fHandler.errorMessage.size());
+	return errorMsg;
+}
 
-	payload["messages"] = messages;
-	payload["max_tokens"] = maxTokens;
-	payload["temperature"] = temperature;
 
-	return BString(json::serialize(payload).c_str());
+CompletionReader::Handler::Handler()
+{
+	Reset();
+}
+
+
+void
+CompletionReader::Handler::Reset()
+{
+	stack[0] = kDocument;
+	depth = 1;
+	ignoredDepth = 0;
+	choicesSeen = 0;
+	keyLength = 0;
+	key = kOtherKey;
+	hasError = false;
+	errorIsObject = false;
+	hasErrorMessage = false;
+
+	// clear() keeps the capacity, which is what makes reuse cheap
+	errorMessage.clear();
+	content.clear();
+	finishReason.clear();
+}
+
+
+CompletionReader::Location
+CompletionReader::Handler::Enter(bool isObject)
+{
+	if (ignoredDepth > 0 || depth == kMaxDepth) {
+		ignoredDepth++;
+		return kIgnored;
+	}
+
+	Location child = kIgnored;
+	switch (stack[depth - 1]) {
+		case kDocument:
+			if (isObject)
+				child = kRoot;
+			break;
+		case kRoot:
+			if (key == kErrorKey) {
+				hasError = true;
+				errorIsObject = isObject;
+				if (isObject)
+					child = kErrorObject;
+			} else if (key == kChoicesKey && !isObject) {
+				child = kChoices;
+			}
+			break;
+		case kChoices:
+			if (choicesSeen++ == 0 && isObject)
+				child = kFirstChoice;
+			break;
+		case kFirstChoice:
+			if ((key == kMessageKey || key == kDeltaKey) && isObject)
+				child = kMessage;
+			break;
+		default:
+			break;
+	}
+
+	key = kOtherKey;
+	if (child == kIgnored)
+		ignoredDepth++;
+	else
+		stack[depth++] = child;
+	return child;
+}
+
+
+void
+CompletionReader::Handler::Leave()
+{
+	if (ignoredDepth > 0)
+		ignoredDepth--;
+	else if (depth > 1)
+		depth--;
+	key = kOtherKey;
+}
+
+
+void
+CompletionReader::Handler::Scalar()
+{
+	if (ignoredDepth == 0) {
+		Location parent = stack[depth - 1];
+		if (parent == kChoices)
+			choicesSeen++;
+		else if (parent == kRoot && key == kErrorKey)
+			hasError = true;
+	}
+	key = kOtherKey;
+}
+
+
+std::string*
+CompletionReader::Handler::StringTarget()
+{
+	if (ignoredDepth > 0)
+		return NULL;
+
+	switch (stack[depth - 1]) {
+		case kErrorObject:
+			if (key == kMessageKey) {
+				hasErrorMessage = true;
+				return &errorMessage;
+			}
+			break;
+		case kFirstChoice:
+			if (key == kFinishReasonKey)
+				return &finishReason;
+			break;
+		case kMessage:
+			if (key == kContentKey)
+				return &content;
+			break;
+		default:
+			break;
+	}
+	return NULL;
 }
 
 
 bool
-JSONParser::HasError(const json::value& jsonValue)
+CompletionReader::Handler::on_document_begin(json::error_code&)
 {
-	if (!jsonValue.is_object())
-		return false;
+	return true;
+}
+
 
-	const json::object& obj = jsonValue.as_object();
-	return obj.contains("error");
+bool
+CompletionReader::Handler::on_document_end(json::error_code&)
+{
+	return true;
 }
 
 
-BString
-JSONParser::ExtractErrorMessage(const json::value& jsonValue)
+bool
+CompletionReader::Handler::on_object_begin(json::error_code&)
 {
-	const json::object& obj = jsonValue.as_object();
-	const json::value& error = obj.at("error");
+	Enter(true);
+	return true;
+}
 
-	if (!error.is_object())
-		return BString("API Error: Unknown error format");
 
-	const json::object& errorObj = error.as_object();
+bool
+CompletionReader::Handler::on_object_end(std::size_t, json::error_code&)
+{
+	Leave();
+	return true;
+}
 
-	if (errorObj.contains("message") && errorObj.at("message").is_string()) {
-		BString errorMsg = "API Error: ";
-		errorMsg += errorObj.at("message").as_string().c_str();
-		return errorMsg;
+
+bool
+CompletionReader::Handler::on_array_begin(json::error_code&)
+{
+	Enter(false);
+	return true;
+}
+
+
+bool
+CompletionReader::Handler::on_array_end(std::size_t, json::error_code&)
+{
+	Leave();
+	return true;
+}
+
+
+bool
+CompletionReader::Handler::on_key_part(json::string_view s, std::size_t, json::error_code&)
+{
+	if (keyLength + s.size() <= sizeof(keyBuffer))
+		memcpy(keyBuffer + keyLength, s.data(), s.size());
+	keyLength += s.size();
+	return true;
+}
+
+
+bool
+CompletionReader::Handler::on_key(json::string_view s, std::size_t, json::error_code& ec)
+{
+	on_key_part(s, 0, ec);
+
+	key = kOtherKey;
+	if (keyLength <= sizeof(keyBuffer)) {
+		json::string_view name(keyBuffer, keyLength);
+		if (name == "error")
+			key = kErrorKey;
+		else if (name == "choices")
+			key = kChoicesKey;
+		else if (name == "message")
+			key = kMessageKey;
+		else if (name == "delta")
+			key = kDeltaKey;
+		else if (name == "content")
+			key = kContentKey;
+		else if (name == "finish_reason")
+			key = kFinishReasonKey;
 	}
+	keyLength = 0;
+	return true;
+}
 
-	return BString("API Error: Unknown API error");
+
+bool
+CompletionReader::Handler::on_string_part(json::string_view s, std::size_t, json::error_code&)
+{
+	// Content is appended straight from the parser's input, already unescaped
+	std::string* target = StringTarget();
+	if (target != NULL)
+		target->append(s.data(), s.size());
+	return true;
 }
 
 
-BString
-JSONParser::ExtractContent(const json::value& jsonValue)
+bool
+CompletionReader::Handler::on_string(json::string_view s, std::size_t n, json::error_code& ec)
 {
-	if (!jsonValue.is_object())
-		return BString();
+	on_string_part(s, n, ec);
+	Scalar();
+	return true;
+}
 
-	const json::object& obj = jsonValue.as_object();
 
-	if (!obj.contains("choices") || !obj.at("choices").is_array())
-		return BString();
+bool
+CompletionReader::Handler::on_number_part(json::string_view, json::error_code&)
+{
+	return true;
+}
 
-	const json::array& choices = obj.at("choices").as_array();
-	if (choices.empty())
-		return BString();
 
-	const json::value& firstChoice = choices[0];
-	if (!firstChoice.is_object())
-		return BString();
+bool
+CompletionReader::Handler::on_int64(int64_t, json::string_view, json::error_code&)
+{
+	Scalar();
+	return true;
+}
+
 
-	const json::object& choiceObj = firstChoice.as_object();
+bool
+CompletionReader::Handler::on_uint64(uint64_t, json::string_view, json::error_code&)
+{
+	Scalar();
+	return true;
+}
 
-	if (!choiceObj.contains("message") || !choiceObj.at("message").is_object())
-		return BString();
 
-	const json::object& messageObj = choiceObj.at("message").as_object();
+bool
+CompletionReader::Handler::on_double(double, json::string_view, json::error_code&)
+{
+	Scalar();
+	return true;
+}
 
-	if (!messageObj.contains("content") || !messageObj.at("content").is_string())
-		return BString();
 
-	return BString(messageObj.at("content").as_string().c_str());
+bool
+CompletionReader::Handler::on_bool(bool, json::error_code&)
+{
+	Scalar();
+	return true;
 }
 
 
 bool
-JSONParser::IsResponseTruncated(const json::value& jsonValue)
+CompletionReader::Handler::on_null(json::error_code&)
 {
-	if (!jsonValue.is_object())
-		return false;
+	Scalar();
+	return true;
+}
 
-	const json::object& obj = jsonValue.as_object();
 
-	if (!obj.contains("choices") || !obj.at("choices").is_array())
-		return false;
+bool
+CompletionReader::Handler::on_comment_part(json::string_view, json::error_code&)
+{
+	return true;
+}
 
-	const json::array& choices = obj.at("choices").as_array();
-	if (choices.empty())
-		return false;
 
-	const json::value& firstChoice = choices[0];
-	if (!firstChoice.is_object())
-		return false;
+bool
+CompletionReader::Handler::on_comment(json::string_view, json::error_code&)
+{
+	return true;
+}
 
-	const json::object& choiceObj = firstChoice.as_object();
 
-	if (!choiceObj.contains("finish_reason") || !choiceObj.at("finish_reason").is_string())
-		return false;
+BString
+JSONParser::ParseAPIResponse(const BString& jsonResponse, bool* succeeded)
+{
+	CompletionReader reader;
+	if (reader.Feed(jsonResponse.String(), jsonResponse.Length()))
+		reader.Finish();
+	return reader.Reading(succeeded);
+}
+
+
+BString
+JSONParser::BuildPayload(const BString& prompt, int maxTokens, float temperature, bool stream)
+{
+	json::object payload;
+
+	payload["model"] = "deepseek-chat";
+
+	json::array messages;
+	json::object message;
+	message["role"] = "user";
+	message["content"] = prompt.String();
+	messages.push_back(message);
+
+	payload["messages"] = messages;
+	payload["max_tokens"] = maxTokens;
+	payload["temperature"] = temperature;
+	if (stream)
+		payload["stream"] = true;
+
+	return BString(json::serialize(payload).c_str());
+}
+
+
+BString
+JSONParser::ParseStreamEvent(const BString& eventData, bool* truncated, bool* failed)
+{
+	// One reader per worker thread, reused for every event of every reading
+	static thread_local CompletionReader sReader;
+
+	*failed = false;
+
+	sReader.Reset();
+	if (!sReader.Feed(eventData.String(), eventData.Length()) || !sReader.Finish()) {
+		*failed = true;
+		BString errorMsg = "Error: Failed to parse streamed API response: ";
+		errorMsg += sReader.ParseError();
+		return errorMsg;
+	}
+
+	if (sReader.HasError()) {
+		*failed = true;
+		return sReader.ErrorMessage();
+	}
+
+	if (sReader.HasFinishReason())
+		*truncated = sReader.IsTruncated();
 
-	std::string finishReason = choiceObj.at("finish_reason").as_string().c_str();
-	return finishReason == "length";
+	const std::string& content = sReader.Content();
+	return BString(content.data(), content.size());
 }
@@ -7,14 +7,118 @@
 
 namespace json = boost::json;
 
-class JSONParser {
+// Pulls the reading out of a chat completion, or out of one event of a
+// streamed completion, in a single pass while the JSON text arrives. No
+// document is built: only the content, finish_reason and error message are
+// kept. A reader can be reused for any number of responses, so its buffers
+// are only allocated once.
+class CompletionReader {
 public:
-	static BString ParseAPIResponse(const BString& jsonResponse);
-	static BString BuildPayload(const BString& prompt, int maxTokens, float temperature);
+	CompletionReader();
+	~CompletionReader();
+
+	void Reset();
+
+	// Parses the next piece of the response. Returns false once the text is
+	// known to be malformed; the rest of the response can be ignored then.
+	bool Feed(const char* data, size_t length);
+
+	// Ends the response. Returns false if it was not complete, well-formed JSON.
+	bool Finish();
+
+	// Returns the reading, or an error message. succeeded, if given, tells
+	// the two apart. Only valid after Finish().
+	BString Reading(bool* succeeded = NULL) const;
+
+	bool HasError() const { return fHandler.hasError; }
+	BString ErrorMessage() const;
+	const std::string& Content() const { return fHandler.content; }
+	bool IsTruncated() const { return fHandler.finishReason == "length"; }
+	bool HasFinishReason() const { return !fHandler.finishReason.empty(); }
+	const BString& ParseError() const { return fParseError; }
 
 private:
-	static bool HasError(const json::value& jsonValue);
-	static BString ExtractErrorMessage(const json::value& jsonValue);
-	static BString ExtractContent(const json::value& jsonValue);
-	static bool IsResponseTruncated(const json::value& jsonValue);
+	enum Location {
+		kDocument, // Outside of any value
+		kRoot, // The top-level object
+		kErrorObject, // root.error
+		kChoices, // root.choices
+		kFirstChoice, // root.choices[0]
+		kMessage, // root.choices[0].message, or .delta of a streamed chunk
+		kIgnored // Anywhere else
+	};
+
+	enum Key { kOtherKey, kErrorKey, kChoicesKey, kMessageKey, kDeltaKey, kContentKey,
+		kFinishReasonKey };
+
+	// Tracks where in the document the parser is, using a fixed-size stack of
+	// the few locations that matter; anything deeper is only counted.
+	struct Handler {
+		static constexpr std::size_t max_object_size = std::size_t(-1);
+		static constexpr std::size_t max_array_size = std::size_t(-1);
+		static constexpr std::size_t max_key_size = std::size_t(-1);
+		static constexpr std::size_t max_string_size = std::size_t(-1);
+
+		Handler();
+		void Reset();
+
+		bool on_document_begin(json::error_code& ec);
+		bool on_document_end(json::error_code& ec);
+		bool on_object_begin(json::error_code& ec);
+		bool on_object_end(std::size_t n, json::error_code& ec);
+		bool on_array_begin(json::error_code& ec);
+		bool on_array_end(std::size_t n, json::error_code& ec);
+		bool on_key_part(json::string_view s, std::size_t n, json::error_code& ec);
+		bool on_key(json::string_view s, std::size_t n, json::error_code& ec);
+		bool on_string_part(json::string_view s, std::size_t n, json::error_code& ec);
+		bool on_string(json::string_view s, std::size_t n, json::error_code& ec);
+		bool on_number_part(json::string_view s, json::error_code& ec);
+		bool on_int64(int64_t i, json::string_view s, json::error_code& ec);
+		bool on_uint64(uint64_t u, json::string_view s, json::error_code& ec);
+		bool on_double(double d, json::string_view s, json::error_code& ec);
+		bool on_bool(bool b, json::error_code& ec);
+		bool on_null(json::error_code& ec);
+		bool on_comment_part(json::string_view s, json::error_code& ec);
+		bool on_comment(json::string_view s, json::error_code& ec);
+
+		Location Enter(bool isObject);
+		void Leave();
+		void Scalar();
+		std::string* StringTarget();
+
+		static const int kMaxDepth = 5;
+		Location stack[kMaxDepth];
+		int depth;
+		int ignoredDepth; // Containers entered below an ignored location
+		int choicesSeen; // Elements of root.choices started so far
+		char keyBuffer[16];
+		size_t keyLength;
+		Key key; // Key of the value about to start in the current object
+
+		bool hasError;
+		bool errorIsObject;
+		bool hasErrorMessage;
+		std::string errorMessage;
+		std::string content;
+		std::string finishReason;
+	};
+
+	json::basic_parser<Handler> fParser;
+	Handler& fHandler;
+	std::string fEcho; // The start of the response, to show when it cannot be parsed
+	BString fParseError;
+	bool fFailed;
+};
+
+class JSONParser {
+public:
+	// Returns the reading, or an error message. succeeded, if given, tells
+	// the two apart.
+	static BString ParseAPIResponse(const BString& jsonResponse, bool* succeeded = NULL);
+	static BString BuildPayload(const BString& prompt, int maxTokens, float temperature,
+		bool stream = false);
+
+	// Parses the data of one server-sent event from a streaming completion.
+	// Returns the content delta, or an error message with failed set.
+	static BString ParseStreamEvent(const BString& eventData, bool* truncated, bool* failed);
 };
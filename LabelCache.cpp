@@ -0,0 +1,105 @@
+#include "LabelCache.h"
+
+
+// A spread shows at most ten cards, but every window width and font size
+// gives them new labels; the limit keeps a long session from piling them up
+static const size_t kMaxLabels = 1024;
+
+
+const LabelCache::Label&
+LabelCache::Fit(const BString& name, const BFont& font, float maxWidth, float truncatedWidth)
+{
+	FontKey fontKey = {font.FamilyAndStyle(), font.Size()};
+	LabelKey key = {name, fontKey, maxWidth, truncatedWidth};
+	auto it = fLabels.find(key);
+	if (it != fLabels.end())
+		return it->second;
+
+	if (fLabels.size() >= kMaxLabels)
+		fLabels.clear();
+
+	Label label;
+	label.text = name;
+	label.width = font.StringWidth(name.String());
+	if (label.width > maxWidth)
+		label = Truncate(name, font, truncatedWidth);
+
+	Label& stored = fLabels[key];
+	stored = label;
+	return stored;
+}
+
+
+const font_height&
+LabelCache::FontHeight(const BFont& font)
+{
+	FontKey key = {font.FamilyAndStyle(), font.Size()};
+	auto it = fFontHeights.find(key);
+	if (it != fFontHeights.end())
+		return it->second;
+
+	font_height& height = fFontHeights[key];
+	font.GetHeight(&height);
+	return height;
+}
+
+
+void
+LabelCache::Clear()
+{
+	fFontHeights.clear();
+	fLabels.clear();
+}
+
+
+LabelCache::Label
+LabelCache::Truncate(const BString& name, const BFont& font, float width)
+{
+	// The label gets wider with every character kept, so the longest prefix
+	// that fits is found in a logarithmic number of measurements. Counting
+	// in characters keeps UTF-8 sequences whole.
+	Label label;
+	label.text = "...";
+	label.width = font.StringWidth(label.text.String());
+
+	int32 low = 0;
+	int32 high = name.CountChars() - 1;
+	while (low < high) {
+		int32 middle = (low + high + 1) / 2;
+		BString text(name);
+		text.TruncateChars(middle);
+		text << "...";
+
+		float textWidth = font.StringWidth(text.String());
+		if (textWidth <= width) {
+			low = middle;
+			label.text = text;
+			label.width = textWidth;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return label;
+}
+
+
+bool
+LabelCache::FontKey::operator<(const FontKey& other) const
+{
+	if (familyAndStyle != other.familyAndStyle)
+		return familyAndStyle < other.familyAndStyle;
+	return size < other.size;
+}
+
+
+bool
+LabelCache::LabelKey::operator<(const LabelKey& other) const
+{
+	if (name != other.name)
+		return name < other.name;
+	if (font < other.font || other.font < font)
+		return font < other.font;
+	if (maxWidth != other.maxWidth)
+		return maxWidth < other.maxWidth;
+	return truncatedWidth < other.truncatedWidth;
+}
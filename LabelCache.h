@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Font.h>
+#include <String.h>
+#include <SupportDefs.h>
+#include <map>
+
+// Fits card labels into the space below a card. A name too wide for it is
+// cut after the most characters that still fit with "..." appended, found by
+// binary search, and every label is remembered by its name, font and width,
+// so that drawing a spread again does not measure any text.
+class LabelCache {
+public:
+	struct Label {
+		BString text; // As it is drawn
+		float width;
+	};
+
+	// The name whole if it is at most maxWidth wide, otherwise shortened to
+	// fit truncatedWidth
+	const Label& Fit(const BString& name, const BFont& font, float maxWidth,
+		float truncatedWidth);
+
+	const font_height& FontHeight(const BFont& font);
+
+	void Clear();
+
+private:
+	struct FontKey {
+		uint32 familyAndStyle;
+		float size;
+
+		bool operator<(const FontKey& other) const;
+	};
+
+	struct LabelKey {
+		BString name;
+		FontKey font;
+		float maxWidth;
+		float truncatedWidth;
+
+		bool operator<(const LabelKey& other) const;
+	};
+
+	static Label Truncate(const BString& name, const BFont& font, float width);
+
+	std::map<FontKey, font_height> fFontHeights;
+	std::map<LabelKey, Label> fLabels;
+};
@@ -0,0 +1,157 @@
+#include "LineBreaker.h"
+
+
+// Readings use a few thousand distinct words at most; the limits only keep
+// memory bounded when the font or width keeps changing
+static const size_t kMaxWordWidths = 32768;
+static const size_t kMaxLineCounts = 4096;
+
+
+static inline int32
+CharacterLength(const char* text, int32 length)
+{
+	// Length of the UTF-8 character at text, so that long words are never
+	// broken in the middle of one
+	uint8 lead = static_cast<uint8>(text[0]);
+	int32 size = lead < 0xc0 ? 1 : lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+	return size < length ? size : length;
+}
+
+
+LineBreaker::LineBreaker()
+	:
+	fWordCount(0)
+{
+}
+
+
+int32
+LineBreaker::CountLines(const char* paragraph, int32 length, const BFont& font, float width)
+{
+	if (length <= 0)
+		return 0;
+
+	// 64-bit FNV-1a of the paragraph
+	uint64 hash = 14695981039346656037ULL;
+	for (int32 i = 0; i < length; i++) {
+		hash ^= static_cast<uint8>(paragraph[i]);
+		hash *= 1099511628211ULL;
+	}
+
+	FontKey fontKey = {font.FamilyAndStyle(), font.Size()};
+	ParagraphKey key = {hash, length, fontKey, width};
+	auto it = fLineCounts.find(key);
+	if (it != fLineCounts.end())
+		return it->second;
+
+	if (fLineCounts.size() >= kMaxLineCounts)
+		fLineCounts.clear();
+	if (fWordCount >= kMaxWordWidths) {
+		fWordWidths.clear();
+		fWordCount = 0;
+	}
+
+	int32 lines = Break(paragraph, length, font, width);
+	fLineCounts[key] = lines;
+	return lines;
+}
+
+
+void
+LineBreaker::Clear()
+{
+	fWordWidths.clear();
+	fLineCounts.clear();
+	fWordCount = 0;
+}
+
+
+float
+LineBreaker::Width(WidthMap& widths, const BFont& font, const char* text, int32 length)
+{
+	std::string word(text, length);
+	auto it = widths.find(word);
+	if (it != widths.end())
+		return it->second;
+
+	float width = font.StringWidth(text, length);
+	widths[word] = width;
+	fWordCount++;
+	return width;
+}
+
+
+int32
+LineBreaker::Break(const char* paragraph, int32 length, const BFont& font, float width)
+{
+	FontKey fontKey = {font.FamilyAndStyle(), font.Size()};
+	WidthMap& widths = fWordWidths[fontKey];
+	float spaceWidth = Width(widths, font, " ", 1);
+
+	int32 lines = 0;
+	float lineWidth = 0;
+	int32 i = 0;
+	while (i < length) {
+		int32 spaces = 0;
+		for (; i < length && paragraph[i] == ' '; i++)
+			spaces++;
+		if (i == length)
+			break;
+
+		int32 start = i;
+		for (; i < length && paragraph[i] != ' '; i++)
+			;
+		float wordWidth = Width(widths, font, paragraph + start, i - start);
+
+		if (lines > 0 && lineWidth + spaces * spaceWidth + wordWidth <= width) {
+			lineWidth += spaces * spaceWidth + wordWidth;
+			continue;
+		}
+
+		// The word starts a new line. Spaces at a break are dropped, but
+		// those the paragraph starts with are kept.
+		lineWidth = lines == 0 ? spaces * spaceWidth : 0;
+		lines++;
+		if (lineWidth + wordWidth <= width) {
+			lineWidth += wordWidth;
+			continue;
+		}
+
+		// Too wide for any line; break it wherever it reaches the edge
+		for (int32 offset = start; offset < i;) {
+			int32 size = CharacterLength(paragraph + offset, i - offset);
+			float characterWidth = Width(widths, font, paragraph + offset, size);
+			if (lineWidth > 0 && lineWidth + characterWidth > width) {
+				lines++;
+				lineWidth = 0;
+			}
+			lineWidth += characterWidth;
+			offset += size;
+		}
+	}
+
+	// A paragraph of nothing but spaces still takes up a line
+	return lines > 0 ? lines : 1;
+}
+
+
+bool
+LineBreaker::FontKey::operator<(const FontKey& other) const
+{
+	if (familyAndStyle != other.familyAndStyle)
+		return familyAndStyle < other.familyAndStyle;
+	return size < other.size;
+}
+
+
+bool
+LineBreaker::ParagraphKey::operator<(const ParagraphKey& other) const
+{
+	if (hash != other.hash)
+		return hash < other.hash;
+	if (length != other.length)
+		return length < other.length;
+	if (font < other.font || other.font < font)
+		return font < other.font;
+	return width < other.width;
+}
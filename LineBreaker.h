@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Font.h>
+#include <SupportDefs.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+// Counts the lines a paragraph takes up when wrapped at spaces, the way a
+// BTextView wraps it. Every word is measured once per font and then looked
+// up, lines are broken greedily in a single pass, and the result for each
+// paragraph is remembered by its text, font and width, so that laying out a
+// long reading again after a resize or an appended chunk costs a hash per
+// paragraph.
+class LineBreaker {
+public:
+	LineBreaker();
+
+	// Lines taken by text without newlines; 0 for an empty paragraph. Words
+	// wider than a line are broken between characters.
+	int32 CountLines(const char* paragraph, int32 length, const BFont& font, float width);
+
+	void Clear();
+
+private:
+	struct FontKey {
+		uint32 familyAndStyle;
+		float size;
+
+		bool operator<(const FontKey& other) const;
+	};
+
+	struct ParagraphKey {
+		uint64 hash;
+		int32 length;
+		FontKey font;
+		float width;
+
+		bool operator<(const ParagraphKey& other) const;
+	};
+
+	typedef std::unordered_map<std::string, float> WidthMap;
+
+	float Width(WidthMap& widths, const BFont& font, const char* text, int32 length);
+	int32 Break(const char* paragraph, int32 length, const BFont& font, float width);
+
+	std::map<FontKey, WidthMap> fWordWidths;
+	std::map<ParagraphKey, int32> fLineCounts;
+	size_t fWordCount; // Entries in all of fWordWidths
+};
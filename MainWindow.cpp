@@ -1,4 +1,6 @@
 #include "MainWindow.h"
+#include "AIReading.h"
+#include "BitmapCache.h"
 #include "CardPresenter.h"
 #include "Config.h"
 #include "SettingsWindow.h"
@@ -76,6 +78,17 @@ MainWindow::MessageReceived(BMessage* message)
 			settingsWindow->Show();
 			break;
 		}
+		case kMsgMemoryReport:
+			// Written to the terminal the application was started from
+			std::cout << BitmapCache::Default().MemoryReport().String() << std::flush;
+			break;
+		case kMsgDrawingReport:
+			if (fCardPresenter)
+				std::cout << fCardPresenter->DrawingReport().String() << std::flush;
+			break;
+		case kMsgNetworkReport:
+			std::cout << AIReading::NetworkReport().String() << std::flush;
+			break;
 		case kMsgAPIKeyReceived:
 		{
 			// Handle API key received from settings window
@@ -168,6 +181,9 @@ MainWindow::_CreateMenuBar()
 	BMenu* appMenu = new BMenu("Ace of Wands");
 	appMenu->AddItem(new BMenuItem("New Reading", new BMessage(kMsgNewReading), 'N'));
 	appMenu->AddItem(new BMenuItem("Settings...", new BMessage(kMsgSettings), 'P'));
+	appMenu->AddItem(new BMenuItem("Print Memory Report", new BMessage(kMsgMemoryReport)));
+	appMenu->AddItem(new BMenuItem("Print Drawing Report", new BMessage(kMsgDrawingReport)));
+	appMenu->AddItem(new BMenuItem("Print Network Report", new BMessage(kMsgNetworkReport)));
 
 	appMenu->AddSeparatorItem();
 
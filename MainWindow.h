@@ -15,7 +15,10 @@ enum {
 	kMsgSettings = 'sett',
 	kMsgAPIKeyReceived = 'akrc',
 	kMsgSpreadChanged = 'spch',
-	kMsgFontSizeChanged = 'fsch'
+	kMsgFontSizeChanged = 'fsch',
+	kMsgMemoryReport = 'memr',
+	kMsgDrawingReport = 'drwr',
+	kMsgNetworkReport = 'netr'
 };
 
 class MainWindow : public BWindow {
@@ -0,0 +1,95 @@
+#include "PayloadTemplate.h"
+#include "JSONParser.h"
+
+#include <string.h>
+
+
+// For every byte: 0 if it is copied as is, otherwise the character that
+// follows the backslash in its escape sequence
+static const char kEscapes[256] = {
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0
+	// The rest, including all of UTF-8, is copied as is
+};
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+
+PayloadTemplate::PayloadTemplate(int maxTokens, float temperature, bool stream)
+{
+	// Serialize once with an empty prompt and cut the result where the prompt
+	// goes, so the fixed parts come out exactly as the DOM path writes them
+	static const char kContent[] = "\"content\":\"";
+	std::string payload
+		= JSONParser::BuildPayload(BString(), maxTokens, temperature, stream).String();
+	size_t split = payload.find(kContent) + strlen(kContent);
+	fPrefix = payload.substr(0, split);
+	fSuffix = payload.substr(split);
+}
+
+
+BString
+PayloadTemplate::Render(const BString& prompt) const
+{
+	size_t promptLength = EscapedLength(prompt.String(), prompt.Length());
+	size_t length = fPrefix.size() + promptLength + fSuffix.size();
+
+	BString payload;
+	char* buffer = payload.LockBuffer(length + 1);
+	if (buffer == NULL)
+		return payload;
+
+	memcpy(buffer, fPrefix.data(), fPrefix.size());
+	char* end = WriteEscaped(buffer + fPrefix.size(), prompt.String(), prompt.Length());
+	memcpy(end, fSuffix.data(), fSuffix.size());
+	payload.UnlockBuffer(length);
+	return payload;
+}
+
+
+size_t
+PayloadTemplate::EscapedLength(const char* text, size_t length)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text);
+	size_t escapedLength = length;
+	for (size_t i = 0; i < length; i++) {
+		char escape = kEscapes[bytes[i]];
+		if (escape != 0)
+			escapedLength += escape == 'u' ? 5 : 1;
+	}
+	return escapedLength;
+}
+
+
+char*
+PayloadTemplate::WriteEscaped(char* destination, const char* text, size_t length)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(text);
+	size_t runStart = 0;
+	for (size_t i = 0; i < length; i++) {
+		char escape = kEscapes[bytes[i]];
+		if (escape == 0)
+			continue;
+
+		// Copy the run of plain bytes before this one in one go
+		memcpy(destination, text + runStart, i - runStart);
+		destination += i - runStart;
+		runStart = i + 1;
+
+		*destination++ = '\\';
+		*destination++ = escape;
+		if (escape == 'u') {
+			*destination++ = '0';
+			*destination++ = '0';
+			*destination++ = kHexDigits[bytes[i] >> 4];
+			*destination++ = kHexDigits[bytes[i] & 0xf];
+		}
+	}
+
+	memcpy(destination, text + runStart, length - runStart);
+	return destination + length - runStart;
+}
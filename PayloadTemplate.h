@@ -0,0 +1,24 @@
+#pragma once
+
+#include <String.h>
+#include <string>
+
+// A chat completion request body with everything but the prompt serialized
+// up front. Rendering only escapes the prompt and splices it between the
+// fixed prefix and suffix, in a single allocation. The output is byte for
+// byte what JSONParser::BuildPayload produces, so cached readings keyed by
+// the payload stay valid.
+class PayloadTemplate {
+public:
+	PayloadTemplate(int maxTokens, float temperature, bool stream);
+
+	BString Render(const BString& prompt) const;
+
+	// JSON string escaping as done by Boost.JSON's serializer.
+	static size_t EscapedLength(const char* text, size_t length);
+	static char* WriteEscaped(char* destination, const char* text, size_t length);
+
+private:
+	std::string fPrefix; // Up to and including the quote opening the prompt
+	std::string fSuffix; // From the quote closing the prompt to the end
+};
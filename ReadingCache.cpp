@@ -0,0 +1,379 @@
+#include "ReadingCache.h"
+#include "Config.h"
+
+#include <Directory.h>
+#include <FindDirectory.h>
+#include <Path.h>
+#include <algorithm>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+
+static const uint32 kSegmentMagic = 'AOWC';
+static const uint32 kSegmentVersion = 1;
+static const size_t kSegmentHeaderSize = 2 * sizeof(uint32);
+// key hash, payload size, text size, creation time
+static const size_t kRecordHeaderSize = sizeof(uint64) + 2 * sizeof(uint32) + sizeof(int64);
+
+
+static bool
+GetSegmentPath(BPath& path)
+{
+	if (find_directory(B_USER_SETTINGS_DIRECTORY, &path) != B_OK)
+		return false;
+
+	path.Append("AceOfWands");
+
+	// Create the directory if it doesn't exist
+	BDirectory dir;
+	if (dir.CreateDirectory(path.Path(), &dir) != B_OK && dir.SetTo(path.Path()) != B_OK)
+		return false;
+
+	path.Append("reading_cache");
+	return true;
+}
+
+
+ReadingCache&
+ReadingCache::Default()
+{
+	static ReadingCache sCache;
+	return sCache;
+}
+
+
+ReadingCache::ReadingCache()
+	:
+	fLoaded(false),
+	fSegmentSize(0),
+	fLiveBytes(0)
+{
+}
+
+
+ReadingCache::~ReadingCache()
+{
+	fSegment.Unset();
+}
+
+
+bool
+ReadingCache::Lookup(const BString& payload, BString& reading)
+{
+	Key key = KeyFor(payload);
+
+	std::lock_guard<std::mutex> lock(fLock);
+
+	auto memoryIt = fMemoryIndex.find(key);
+	if (memoryIt != fMemoryIndex.end()) {
+		if (!IsExpired(memoryIt->second->created)) {
+			fRecent.splice(fRecent.begin(), fRecent, memoryIt->second);
+			reading = memoryIt->second->reading;
+			return true;
+		}
+		fRecent.erase(memoryIt->second);
+		fMemoryIndex.erase(memoryIt);
+	}
+
+	LoadLocked();
+
+	auto diskIt = fDiskIndex.find(key);
+	if (diskIt == fDiskIndex.end())
+		return false;
+
+	if (IsExpired(diskIt->second.created)) {
+		fLiveBytes -= kRecordHeaderSize + diskIt->second.textSize;
+		fDiskIndex.erase(diskIt);
+		return false;
+	}
+
+	if (!ReadTextLocked(diskIt->second, reading))
+		return false;
+
+	RememberLocked(key, reading, diskIt->second.created);
+	return true;
+}
+
+
+void
+ReadingCache::Store(const BString& payload, const BString& reading)
+{
+	Key key = KeyFor(payload);
+	int64 created = time(NULL);
+
+	std::lock_guard<std::mutex> lock(fLock);
+	LoadLocked();
+
+	RememberLocked(key, reading, created);
+
+	// The replaced record stops counting as live only once the new one is
+	// written; until then it is still the one in the index
+	off_t replacedBytes = 0;
+	auto diskIt = fDiskIndex.find(key);
+	if (diskIt != fDiskIndex.end())
+		replacedBytes = kRecordHeaderSize + diskIt->second.textSize;
+
+	if (!AppendLocked(key, reading, created))
+		return;
+	fLiveBytes -= replacedBytes;
+
+	// Compact when over budget, or when replaced and expired records make up
+	// more than half of the budget
+	if (fSegmentSize > Config::kReadingCacheMaxDiskBytes
+		|| fSegmentSize - fLiveBytes > Config::kReadingCacheMaxDiskBytes / 2) {
+		CompactLocked();
+	}
+}
+
+
+void
+ReadingCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(fLock);
+	fRecent.clear();
+	fMemoryIndex.clear();
+	fDiskIndex.clear();
+	fLiveBytes = 0;
+	fLoaded = true;
+	OpenSegmentLocked(true);
+}
+
+
+ReadingCache::Key
+ReadingCache::KeyFor(const BString& payload)
+{
+	// 64-bit FNV-1a; the payload length is kept next to it to make an
+	// accidental collision between two different prompts even less likely.
+	uint64 hash = 14695981039346656037ULL;
+	const uint8* bytes = reinterpret_cast<const uint8*>(payload.String());
+	for (int32 i = 0; i < payload.Length(); i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	Key key = {hash, static_cast<uint32>(payload.Length())};
+	return key;
+}
+
+
+bool
+ReadingCache::IsExpired(int64 created)
+{
+	return time(NULL) - created > Config::kReadingCacheTTL;
+}
+
+
+void
+ReadingCache::LoadLocked()
+{
+	if (fLoaded)
+		return;
+	fLoaded = true;
+
+	if (!OpenSegmentLocked(false))
+		return;
+
+	uint32 header[2];
+	if (fSegmentSize < static_cast<off_t>(kSegmentHeaderSize)
+		|| fSegment.ReadAt(0, header, sizeof(header)) != sizeof(header)
+		|| header[0] != kSegmentMagic || header[1] != kSegmentVersion) {
+		// Missing, foreign or outdated segment; start over
+		OpenSegmentLocked(true);
+		return;
+	}
+
+	// Later records for the same key replace earlier ones
+	off_t offset = kSegmentHeaderSize;
+	uint8 recordHeader[kRecordHeaderSize];
+	while (offset + static_cast<off_t>(kRecordHeaderSize) <= fSegmentSize) {
+		if (fSegment.ReadAt(offset, recordHeader, kRecordHeaderSize)
+			!= static_cast<ssize_t>(kRecordHeaderSize)) {
+			break;
+		}
+
+		Key key;
+		uint32 textSize;
+		DiskEntry entry;
+		memcpy(&key.hash, recordHeader, sizeof(uint64));
+		memcpy(&key.payloadSize, recordHeader + 8, sizeof(uint32));
+		memcpy(&textSize, recordHeader + 12, sizeof(uint32));
+		memcpy(&entry.created, recordHeader + 16, sizeof(int64));
+		entry.textOffset = offset + kRecordHeaderSize;
+		entry.textSize = textSize;
+
+		if (entry.textOffset + textSize > fSegmentSize)
+			break; // Torn write at the end of the file
+
+		auto existing = fDiskIndex.find(key);
+		if (existing != fDiskIndex.end())
+			fLiveBytes -= kRecordHeaderSize + existing->second.textSize;
+
+		if (IsExpired(entry.created)) {
+			if (existing != fDiskIndex.end())
+				fDiskIndex.erase(existing);
+		} else {
+			fDiskIndex[key] = entry;
+			fLiveBytes += kRecordHeaderSize + textSize;
+		}
+
+		offset = entry.textOffset + textSize;
+	}
+
+	// Drop a torn tail so the next append starts on a record boundary
+	if (offset < fSegmentSize) {
+		fSegment.SetSize(offset);
+		fSegmentSize = offset;
+	}
+}
+
+
+bool
+ReadingCache::OpenSegmentLocked(bool truncate)
+{
+	fSegment.Unset();
+	fSegmentSize = 0;
+
+	BPath path;
+	if (!GetSegmentPath(path))
+		return false;
+
+	uint32 openMode = B_READ_WRITE | B_CREATE_FILE;
+	if (truncate)
+		openMode |= B_ERASE_FILE;
+
+	if (fSegment.SetTo(path.Path(), openMode) != B_OK)
+		return false;
+
+	if (fSegment.GetSize(&fSegmentSize) != B_OK)
+		fSegmentSize = 0;
+
+	if (fSegmentSize == 0) {
+		uint32 header[2] = {kSegmentMagic, kSegmentVersion};
+		if (fSegment.WriteAt(0, header, sizeof(header)) != sizeof(header)) {
+			fSegment.Unset();
+			return false;
+		}
+		fSegmentSize = sizeof(header);
+		Config::RegisterFileWithMime(path.Path(), "application/octet-stream");
+	}
+
+	return true;
+}
+
+
+bool
+ReadingCache::AppendLocked(const Key& key, const BString& reading, int64 created)
+{
+	if (fSegment.InitCheck() != B_OK)
+		return false;
+
+	uint32 textSize = reading.Length();
+	uint8 recordHeader[kRecordHeaderSize];
+	memcpy(recordHeader, &key.hash, sizeof(uint64));
+	memcpy(recordHeader + 8, &key.payloadSize, sizeof(uint32));
+	memcpy(recordHeader + 12, &textSize, sizeof(uint32));
+	memcpy(recordHeader + 16, &created, sizeof(int64));
+
+	off_t offset = fSegmentSize;
+	if (fSegment.WriteAt(offset, recordHeader, kRecordHeaderSize)
+			!= static_cast<ssize_t>(kRecordHeaderSize)
+		|| fSegment.WriteAt(offset + kRecordHeaderSize, reading.String(), textSize)
+			!= static_cast<ssize_t>(textSize)) {
+		fSegment.SetSize(offset);
+		return false;
+	}
+
+	DiskEntry entry = {static_cast<off_t>(offset + kRecordHeaderSize), textSize, created};
+	fDiskIndex[key] = entry;
+	fSegmentSize = entry.textOffset + textSize;
+	fLiveBytes += kRecordHeaderSize + textSize;
+	return true;
+}
+
+
+bool
+ReadingCache::ReadTextLocked(const DiskEntry& entry, BString& reading)
+{
+	if (fSegment.InitCheck() != B_OK)
+		return false;
+
+	char* buffer = reading.LockBuffer(entry.textSize + 1);
+	if (buffer == NULL)
+		return false;
+
+	ssize_t bytesRead = fSegment.ReadAt(entry.textOffset, buffer, entry.textSize);
+	reading.UnlockBuffer(bytesRead == static_cast<ssize_t>(entry.textSize) ? entry.textSize : 0);
+	return bytesRead == static_cast<ssize_t>(entry.textSize);
+}
+
+
+void
+ReadingCache::CompactLocked()
+{
+	struct LiveRecord {
+		Key key;
+		int64 created;
+		BString reading;
+	};
+
+	// Keep the newest readings until the segment is down to half its budget,
+	// so that compaction does not have to run again on the very next store.
+	std::vector<std::pair<Key, DiskEntry>> entries(fDiskIndex.begin(), fDiskIndex.end());
+	std::sort(entries.begin(), entries.end(),
+		[](const std::pair<Key, DiskEntry>& a, const std::pair<Key, DiskEntry>& b) {
+			return a.second.created > b.second.created;
+		});
+
+	std::vector<LiveRecord> keep;
+	off_t keptBytes = kSegmentHeaderSize;
+	for (size_t i = 0; i < entries.size(); i++) {
+		const DiskEntry& entry = entries[i].second;
+		if (IsExpired(entry.created))
+			continue;
+
+		off_t recordSize = kRecordHeaderSize + entry.textSize;
+		if (keptBytes + recordSize > Config::kReadingCacheMaxDiskBytes / 2)
+			break;
+
+		LiveRecord record;
+		record.key = entries[i].first;
+		record.created = entry.created;
+		if (!ReadTextLocked(entry, record.reading))
+			continue;
+
+		keep.push_back(record);
+		keptBytes += recordSize;
+	}
+
+	fDiskIndex.clear();
+	fLiveBytes = 0;
+	if (!OpenSegmentLocked(true))
+		return;
+
+	// Write oldest first so the file stays in creation order
+	for (auto it = keep.rbegin(); it != keep.rend(); ++it)
+		AppendLocked(it->key, it->reading, it->created);
+}
+
+
+void
+ReadingCache::RememberLocked(const Key& key, const BString& reading, int64 created)
+{
+	auto memoryIt = fMemoryIndex.find(key);
+	if (memoryIt != fMemoryIndex.end()) {
+		memoryIt->second->created = created;
+		memoryIt->second->reading = reading;
+		fRecent.splice(fRecent.begin(), fRecent, memoryIt->second);
+		return;
+	}
+
+	MemoryEntry entry = {key, created, reading};
+	fRecent.push_front(entry);
+	fMemoryIndex[key] = fRecent.begin();
+
+	while (fRecent.size() > static_cast<size_t>(Config::kReadingCacheMemoryEntries)) {
+		fMemoryIndex.erase(fRecent.back().key);
+		fRecent.pop_back();
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <File.h>
+#include <String.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Content-addressed cache of AI readings, keyed by the request payload so
+// that the model and every request parameter take part in the key. Recently
+// used readings are kept in memory; all of them are kept in a single
+// append-only segment file in the settings directory, which is compacted when
+// it grows past its size budget.
+class ReadingCache {
+public:
+	static ReadingCache& Default();
+
+	bool Lookup(const BString& payload, BString& reading);
+	void Store(const BString& payload, const BString& reading);
+
+	void Clear();
+
+private:
+	struct Key {
+		uint64 hash;
+		uint32 payloadSize;
+
+		bool operator==(const Key& other) const
+		{
+			return hash == other.hash && payloadSize == other.payloadSize;
+		}
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& key) const { return static_cast<size_t>(key.hash); }
+	};
+
+	struct MemoryEntry {
+		Key key;
+		int64 created;
+		BString reading;
+	};
+
+	struct DiskEntry {
+		off_t textOffset;
+		uint32 textSize;
+		int64 created;
+	};
+
+	ReadingCache();
+	~ReadingCache();
+
+	static Key KeyFor(const BString& payload);
+	static bool IsExpired(int64 created);
+
+	void LoadLocked();
+	bool OpenSegmentLocked(bool truncate);
+	bool AppendLocked(const Key& key, const BString& reading, int64 created);
+	bool ReadTextLocked(const DiskEntry& entry, BString& reading);
+	void CompactLocked();
+	void RememberLocked(const Key& key, const BString& reading, int64 created);
+
+	std::mutex fLock;
+	bool fLoaded;
+	BFile fSegment;
+	off_t fSegmentSize;
+	off_t fLiveBytes;
+
+	std::list<MemoryEntry> fRecent; // Most recently used first
+	std::unordered_map<Key, std::list<MemoryEntry>::iterator, KeyHash> fMemoryIndex;
+	std::unordered_map<Key, DiskEntry, KeyHash> fDiskIndex;
+};
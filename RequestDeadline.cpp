@@ -0,0 +1,129 @@
+#include "RequestDeadline.h"
+#include "CancellationToken.h"
+#include "Config.h"
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+
+
+RequestDeadline::RequestDeadline(CancellationToken* cancelToken)
+	:
+	fCancelToken(cancelToken),
+	fOverallDeadline(std::chrono::steady_clock::now() + std::chrono::seconds(Config::kAPITimeout)),
+	fTimedOut(false),
+	fCancelled(false),
+	fExpiredPhase(kPhaseResolve)
+{
+}
+
+
+RequestDeadline::~RequestDeadline()
+{
+	if (fCancelToken != NULL)
+		fCancelToken->ClearWakeHook();
+}
+
+
+boost::system::error_code
+RequestDeadline::Run(boost::asio::io_context& ioContext, RequestPhase phase,
+	const Operation& operation, const Abort& abort)
+{
+	if (fTimedOut || fCancelled)
+		return boost::asio::error::operation_aborted;
+
+	if (fCancelToken != NULL && fCancelToken->IsCancelled()) {
+		fCancelled = true;
+		return boost::asio::error::operation_aborted;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	auto deadline = now + PhaseTimeout(phase);
+	if (deadline > fOverallDeadline)
+		deadline = fOverallDeadline;
+
+	// A cancel from another thread posts a no-op so that run_one_until()
+	// returns and the token is checked right away.
+	if (fCancelToken != NULL) {
+		fCancelToken->SetWakeHook(
+			[&ioContext]() { boost::asio::post(ioContext, []() {}); });
+	}
+
+	boost::system::error_code result;
+	bool done = false;
+
+	ioContext.restart();
+	operation([&](const boost::system::error_code& ec) {
+		result = ec;
+		done = true;
+	});
+
+	bool aborted = false;
+	while (!done) {
+		if (!aborted) {
+			if (fCancelToken != NULL && fCancelToken->IsCancelled()) {
+				fCancelled = true;
+				abort();
+				aborted = true;
+			} else if (std::chrono::steady_clock::now() >= deadline) {
+				fTimedOut = true;
+				fExpiredPhase = phase;
+				abort();
+				aborted = true;
+			}
+		}
+
+		// Once aborted, the operation completes promptly with an error, so
+		// there is no deadline left to wait for.
+		if (aborted)
+			ioContext.run_one();
+		else
+			ioContext.run_one_until(deadline);
+
+		if (ioContext.stopped() && !done)
+			ioContext.restart();
+	}
+
+	if (fCancelToken != NULL)
+		fCancelToken->ClearWakeHook();
+
+	return result;
+}
+
+
+const char*
+RequestDeadline::PhaseName(RequestPhase phase)
+{
+	switch (phase) {
+		case kPhaseResolve:
+			return "resolving the host";
+		case kPhaseConnect:
+			return "connecting";
+		case kPhaseHandshake:
+			return "negotiating TLS";
+		case kPhaseWrite:
+			return "sending the request";
+		case kPhaseRead:
+			return "waiting for the response";
+		default:
+			return "processing the request";
+	}
+}
+
+
+std::chrono::seconds
+RequestDeadline::PhaseTimeout(RequestPhase phase)
+{
+	switch (phase) {
+		case kPhaseResolve:
+			return std::chrono::seconds(Config::kAPIResolveTimeout);
+		case kPhaseConnect:
+			return std::chrono::seconds(Config::kAPIConnectTimeout);
+		case kPhaseHandshake:
+			return std::chrono::seconds(Config::kAPIHandshakeTimeout);
+		case kPhaseWrite:
+			return std::chrono::seconds(Config::kAPIWriteTimeout);
+		case kPhaseRead:
+		default:
+			return std::chrono::seconds(Config::kAPIReadTimeout);
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <SupportDefs.h>
+#include <boost/asio/io_context.hpp>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <functional>
+
+class CancellationToken;
+
+enum RequestPhase {
+	kPhaseResolve,
+	kPhaseConnect,
+	kPhaseHandshake,
+	kPhaseWrite,
+	kPhaseRead,
+	kPhaseCount
+};
+
+// Drives the asynchronous operations of one HTTP request on the calling
+// thread. Each operation is bounded by its phase timeout and by the overall
+// request timeout, and is aborted early when the request is cancelled.
+class RequestDeadline {
+public:
+	typedef std::function<void(const boost::system::error_code& ec)> Completion;
+	typedef std::function<void(const Completion& done)> Operation;
+	typedef std::function<void()> Abort;
+
+	RequestDeadline(CancellationToken* cancelToken);
+	~RequestDeadline();
+
+	// Starts operation on ioContext and runs the context until it completes.
+	// If the deadline passes or the request is cancelled first, abort is called
+	// and the operation's error (usually operation_aborted) is returned.
+	boost::system::error_code Run(boost::asio::io_context& ioContext, RequestPhase phase,
+		const Operation& operation, const Abort& abort);
+
+	bool TimedOut() const { return fTimedOut; }
+	bool Cancelled() const { return fCancelled; }
+	RequestPhase ExpiredPhase() const { return fExpiredPhase; }
+
+	static const char* PhaseName(RequestPhase phase);
+
+private:
+	static std::chrono::seconds PhaseTimeout(RequestPhase phase);
+
+	CancellationToken* fCancelToken;
+	std::chrono::steady_clock::time_point fOverallDeadline;
+	bool fTimedOut;
+	bool fCancelled;
+	RequestPhase fExpiredPhase;
+};
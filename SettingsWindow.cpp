@@ -1,6 +1,7 @@
 #include "SettingsWindow.h"
 #include "Config.h"
 #include "MainWindow.h"
+#include "ReadingCache.h"
 
 #include <Alert.h>
 #include <Button.h>
@@ -34,6 +35,9 @@ SettingsWindow::SettingsWindow(BWindow* owner)
 	BString apiKey = Config::LoadAPIKeyFromFile();
 	fAPIKeyInput->SetText(apiKey.String());
 
+	fEndpointInput = new BTextControl("endpointInput", "API Endpoint:", "", NULL);
+	fEndpointInput->SetText(Config::GetAPIEndpoint().String());
+
 	fSpreadMenu = new BPopUpMenu("Spread");
 	fSpreadMenu->AddItem(new BMenuItem("Three Card", new BMessage(kMsgSpreadChanged)));
 	fSpreadMenu->AddItem(new BMenuItem("Tree of Life", new BMessage(kMsgSpreadChanged)));
@@ -51,6 +55,31 @@ SettingsWindow::SettingsWindow(BWindow* owner)
 		new BMessage(kMsgLogReadingsChanged));
 	fLogReadingsCheckbox->SetValue(Config::GetLogReadings() ? B_CONTROL_ON : B_CONTROL_OFF);
 
+	fStreamReadingsCheckbox = new BCheckBox("streamReadings", "Show AI readings as they arrive",
+		new BMessage(kMsgStreamReadingsChanged));
+	fStreamReadingsCheckbox->SetValue(
+		Config::GetStreamReadings() ? B_CONTROL_ON : B_CONTROL_OFF);
+
+	fBypassCacheCheckbox = new BCheckBox("bypassCache", "Always fetch a fresh AI reading",
+		new BMessage(kMsgBypassCacheChanged));
+	fBypassCacheCheckbox->SetValue(Config::GetBypassReadingCache() ? B_CONTROL_ON : B_CONTROL_OFF);
+
+	fClearCacheButton = new BButton("clearCache", "Clear Cached Readings",
+		new BMessage(kMsgClearReadingCache));
+
+	fPrefetchCheckbox = new BCheckBox("prefetch", "Prepare the next reading in the background",
+		new BMessage(kMsgPrefetchChanged));
+	fPrefetchCheckbox->SetValue(Config::GetPrefetchReadings() ? B_CONTROL_ON : B_CONTROL_OFF);
+
+	fPreloadDeckCheckbox = new BCheckBox("preloadDeck", "Prepare card images at startup",
+		new BMessage(kMsgPreloadDeckChanged));
+	fPreloadDeckCheckbox->SetValue(Config::GetPreloadDeck() ? B_CONTROL_ON : B_CONTROL_OFF);
+
+	fCardPreviewsCheckbox = new BCheckBox("cardPreviews", "Show card previews while loading",
+		new BMessage(kMsgCardPreviewsChanged));
+	fCardPreviewsCheckbox->SetValue(
+		Config::GetShowCardPreviews() ? B_CONTROL_ON : B_CONTROL_OFF);
+
 	fFontSizeInput = new BTextControl("fontSizeInput", "Font Size:", "",
 		new BMessage(kMsgSettingsFontSizeChanged));
 	BString fontSize;
@@ -65,12 +94,19 @@ SettingsWindow::SettingsWindow(BWindow* owner)
 	apiKeyLayout->SetInsets(0, 0, 0, 0);
 	apiKeyLayout->AddView(fInstructions);
 	apiKeyLayout->AddView(fAPIKeyInput);
+	apiKeyLayout->AddView(fEndpointInput);
 
 	BGroupView* spreadGroup = new BGroupView("Spread Settings", B_VERTICAL, 0);
 	BGroupLayout* spreadLayout = spreadGroup->GroupLayout();
 	spreadLayout->SetInsets(0, 0, 0, 0);
 	spreadLayout->AddView(fSpreadMenuField);
 	spreadLayout->AddView(fLogReadingsCheckbox);
+	spreadLayout->AddView(fStreamReadingsCheckbox);
+	spreadLayout->AddView(fBypassCacheCheckbox);
+	spreadLayout->AddView(fClearCacheButton);
+	spreadLayout->AddView(fPrefetchCheckbox);
+	spreadLayout->AddView(fPreloadDeckCheckbox);
+	spreadLayout->AddView(fCardPreviewsCheckbox);
 
 	BGroupLayout* layout = new BGroupLayout(B_VERTICAL, B_USE_DEFAULT_SPACING);
 	this->SetLayout(layout);
@@ -115,6 +151,12 @@ SettingsWindow::MessageReceived(BMessage* msg)
 				Config::SetFontSize(static_cast<float>(size));
 			}
 			Config::SetAPIKey(fAPIKeyInput->Text());
+			// Storing the default keeps following it if it ever changes
+			BString endpoint = fEndpointInput->Text();
+			endpoint.Trim();
+			if (endpoint == Config::kDefaultAPIEndpoint)
+				endpoint = "";
+			Config::SetAPIEndpoint(endpoint);
 			BMenuItem* item = fSpreadMenu->FindMarked();
 			if (item) {
 				int32 index = fSpreadMenu->IndexOf(item);
@@ -122,6 +164,11 @@ SettingsWindow::MessageReceived(BMessage* msg)
 			}
 			// Save the log readings setting
 			Config::SetLogReadings(fLogReadingsCheckbox->Value() == B_CONTROL_ON);
+			Config::SetStreamReadings(fStreamReadingsCheckbox->Value() == B_CONTROL_ON);
+			Config::SetBypassReadingCache(fBypassCacheCheckbox->Value() == B_CONTROL_ON);
+			Config::SetPrefetchReadings(fPrefetchCheckbox->Value() == B_CONTROL_ON);
+			Config::SetPreloadDeck(fPreloadDeckCheckbox->Value() == B_CONTROL_ON);
+			Config::SetShowCardPreviews(fCardPreviewsCheckbox->Value() == B_CONTROL_ON);
 
 			BMessage reply(kMsgAPIKeyReceived);
 			reply.AddString("apiKey", fAPIKeyInput->Text());
@@ -140,11 +187,21 @@ SettingsWindow::MessageReceived(BMessage* msg)
 			break;
 		}
 		case kMsgLogReadingsChanged:
+		case kMsgStreamReadingsChanged:
+		case kMsgBypassCacheChanged:
+		case kMsgPrefetchChanged:
+		case kMsgPreloadDeckChanged:
+		case kMsgCardPreviewsChanged:
 		{
 			// The checkbox state has changed, but we don't need to do anything here
 			// since we'll save all settings when the user clicks OK
 			break;
 		}
+		case kMsgClearReadingCache:
+			// Takes effect right away, whether or not the window is closed with OK
+			ReadingCache::Default().Clear();
+			fClearCacheButton->SetEnabled(false);
+			break;
 		case kMsgSettingsFontSizeChanged:
 		{
 			// Send font size change message to main window immediately
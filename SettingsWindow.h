@@ -13,6 +13,12 @@ class BCheckBox;
 
 const uint32 kMsgSaveAPIKey = 'SvAK';
 const uint32 kMsgLogReadingsChanged = 'LogR';
+const uint32 kMsgStreamReadingsChanged = 'StrR';
+const uint32 kMsgBypassCacheChanged = 'BpsC';
+const uint32 kMsgClearReadingCache = 'ClrC';
+const uint32 kMsgPrefetchChanged = 'PfcR';
+const uint32 kMsgPreloadDeckChanged = 'PldD';
+const uint32 kMsgCardPreviewsChanged = 'CPrv';
 // Rename the constant to avoid conflict
 const uint32 kMsgSettingsFontSizeChanged = 'FnSz';
 
@@ -26,11 +32,18 @@ public:
 
 private:
 	BTextControl* fAPIKeyInput;
+	BTextControl* fEndpointInput;
 	BTextControl* fFontSizeInput;
 	BButton* fSaveButton;
 	BStringView* fInstructions;
 	BMenuField* fSpreadMenuField;
 	BPopUpMenu* fSpreadMenu;
 	BCheckBox* fLogReadingsCheckbox;
+	BCheckBox* fStreamReadingsCheckbox;
+	BCheckBox* fBypassCacheCheckbox;
+	BButton* fClearCacheButton;
+	BCheckBox* fPrefetchCheckbox;
+	BCheckBox* fPreloadDeckCheckbox;
+	BCheckBox* fCardPreviewsCheckbox;
 	BMessenger fOwnerMessenger;
 };
@@ -0,0 +1,104 @@
+#include "TLSContext.h"
+
+#include <atomic>
+
+
+namespace ssl = boost::asio::ssl;
+
+static std::once_flag sContextOnce;
+static std::shared_ptr<ssl::context> sContext;
+
+static std::mutex sSessionLock;
+static std::map<std::string, SSL_SESSION*> sSessions;
+
+static std::atomic<uint64> sFullHandshakes(0);
+static std::atomic<uint64> sResumedHandshakes(0);
+
+
+std::shared_ptr<ssl::context>
+TLSContext::Shared()
+{
+	std::call_once(sContextOnce, []() {
+		std::shared_ptr<ssl::context> context
+			= std::make_shared<ssl::context>(ssl::context::tls_client);
+		context->set_default_verify_paths();
+		context->set_verify_mode(ssl::verify_peer);
+
+		// TLS 1.3 where the server offers it, and nothing older than 1.2.
+		// Keep sessions out of OpenSSL's internal cache, which is keyed by
+		// session ID rather than host, and collect them ourselves instead.
+		// TLS 1.3 tickets arrive after the handshake, so the callback is the
+		// only reliable place to pick them up.
+		SSL_CTX* native = context->native_handle();
+		SSL_CTX_set_min_proto_version(native, TLS1_2_VERSION);
+		SSL_CTX_set_session_cache_mode(native,
+			SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(native, &TLSContext::NewSessionCallback);
+
+		sContext = context;
+	});
+
+	return sContext;
+}
+
+
+void
+TLSContext::PrepareSession(SSL* ssl, const BString& host)
+{
+	std::lock_guard<std::mutex> lock(sSessionLock);
+	auto it = sSessions.find(host.String());
+	if (it != sSessions.end())
+		SSL_set_session(ssl, it->second);
+}
+
+
+void
+TLSContext::RecordHandshake(SSL* ssl)
+{
+	if (SSL_session_reused(ssl))
+		sResumedHandshakes++;
+	else
+		sFullHandshakes++;
+}
+
+
+uint64
+TLSContext::FullHandshakeCount()
+{
+	return sFullHandshakes.load();
+}
+
+
+uint64
+TLSContext::ResumedHandshakeCount()
+{
+	return sResumedHandshakes.load();
+}
+
+
+int
+TLSContext::NewSessionCallback(SSL* ssl, SSL_SESSION* session)
+{
+	const char* host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+	if (host == NULL)
+		return 0;
+
+	StoreSession(host, session);
+
+	// Returning 1 tells OpenSSL that we took over the reference.
+	return 1;
+}
+
+
+void
+TLSContext::StoreSession(const std::string& host, SSL_SESSION* session)
+{
+	std::lock_guard<std::mutex> lock(sSessionLock);
+	auto it = sSessions.find(host);
+	if (it != sSessions.end()) {
+		SSL_SESSION_free(it->second);
+		it->second = session;
+	} else {
+		sSessions[host] = session;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <String.h>
+#include <boost/asio/ssl.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Process-wide client TLS state. The CA store is loaded once into a shared
+// context, and the most recent session ticket for every host is kept so that
+// rebuilt connections can resume instead of running a full key exchange.
+class TLSContext {
+public:
+	static std::shared_ptr<boost::asio::ssl::context> Shared();
+
+	// Offers the cached session for host, if any, on a connection that has not
+	// yet performed its handshake.
+	static void PrepareSession(SSL* ssl, const BString& host);
+
+	// Counts a completed handshake as full or resumed.
+	static void RecordHandshake(SSL* ssl);
+
+	static uint64 FullHandshakeCount();
+	static uint64 ResumedHandshakeCount();
+
+private:
+	static int NewSessionCallback(SSL* ssl, SSL_SESSION* session);
+	static void StoreSession(const std::string& host, SSL_SESSION* session);
+};
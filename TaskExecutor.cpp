@@ -0,0 +1,153 @@
+#include "TaskExecutor.h"
+
+
+TaskExecutor::TaskExecutor(int32 workerCount)
+	:
+	fWorkerCount(workerCount < 1 ? 1 : workerCount),
+	fRunningBackground(0),
+	fQuitting(false),
+	fGeneration(0)
+{
+	for (int32 i = 0; i < fWorkerCount; i++)
+		fWorkers.emplace_back(&TaskExecutor::WorkerLoop, this);
+}
+
+
+TaskExecutor::~TaskExecutor()
+{
+	Shutdown();
+}
+
+
+void
+TaskExecutor::Submit(Lane lane, const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		if (fQuitting)
+			return;
+
+		QueuedTask queued = {task, fGeneration.load()};
+		if (lane == kInteractiveLane)
+			fInteractive.push_back(queued);
+		else
+			fBackground.push_back(queued);
+	}
+	fCondition.notify_one();
+}
+
+
+uint32
+TaskExecutor::AdvanceGeneration()
+{
+	std::lock_guard<std::mutex> lock(fLock);
+	uint32 generation = ++fGeneration;
+	DropStaleLocked(fInteractive);
+	DropStaleLocked(fBackground);
+	return generation;
+}
+
+
+uint32
+TaskExecutor::CurrentGeneration() const
+{
+	return fGeneration.load();
+}
+
+
+bool
+TaskExecutor::IsCurrent(uint32 generation) const
+{
+	return generation == fGeneration.load();
+}
+
+
+void
+TaskExecutor::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(fLock);
+		if (fQuitting && fWorkers.empty())
+			return;
+		fQuitting = true;
+		fInteractive.clear();
+		fBackground.clear();
+	}
+	fCondition.notify_all();
+
+	for (size_t i = 0; i < fWorkers.size(); i++) {
+		if (fWorkers[i].joinable())
+			fWorkers[i].join();
+	}
+	fWorkers.clear();
+}
+
+
+void
+TaskExecutor::WorkerLoop()
+{
+	while (true) {
+		QueuedTask next;
+		Lane lane;
+		if (!NextTask(next, lane))
+			return;
+
+		next.task(next.generation);
+
+		if (lane == kBackgroundLane) {
+			{
+				std::lock_guard<std::mutex> lock(fLock);
+				fRunningBackground--;
+			}
+			// A worker freed by background work may now take queued background work
+			fCondition.notify_all();
+		}
+	}
+}
+
+
+bool
+TaskExecutor::NextTask(QueuedTask& next, Lane& lane)
+{
+	std::unique_lock<std::mutex> lock(fLock);
+
+	// Background work may use every worker but one, so an interactive request
+	// never has to wait behind a prefetch.
+	int32 backgroundLimit = fWorkerCount - 1;
+	if (backgroundLimit < 1)
+		backgroundLimit = 1;
+
+	fCondition.wait(lock, [&]() {
+		return fQuitting || !fInteractive.empty()
+			|| (!fBackground.empty() && fRunningBackground < backgroundLimit);
+	});
+
+	if (fQuitting)
+		return false;
+
+	if (!fInteractive.empty()) {
+		next = fInteractive.front();
+		fInteractive.pop_front();
+		lane = kInteractiveLane;
+	} else {
+		next = fBackground.front();
+		fBackground.pop_front();
+		lane = kBackgroundLane;
+		fRunningBackground++;
+	}
+
+	return true;
+}
+
+
+void
+TaskExecutor::DropStaleLocked(std::deque<QueuedTask>& queue)
+{
+	uint32 generation = fGeneration.load();
+	for (auto it = queue.begin(); it != queue.end();) {
+		if (it->generation != generation)
+			it = queue.erase(it);
+		else
+			++it;
+	}
+}
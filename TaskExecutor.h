@@ -0,0 +1,57 @@
+#pragma once
+
+#include <SupportDefs.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small persistent worker pool, used for readings as well as for decoding
+// and scaling card images. Submitting never waits on earlier tasks. Every task
+// is tagged with the generation that was current when it was submitted;
+// advancing the generation drops queued tasks of older generations and lets
+// running ones find out that their result is stale.
+class TaskExecutor {
+public:
+	enum Lane {
+		kInteractiveLane, // Work the user is waiting for
+		kBackgroundLane // Speculative work, never allowed to take the last free worker
+	};
+
+	typedef std::function<void(uint32 generation)> Task;
+
+	TaskExecutor(int32 workerCount);
+	~TaskExecutor();
+
+	void Submit(Lane lane, const Task& task);
+
+	uint32 AdvanceGeneration();
+	uint32 CurrentGeneration() const;
+	bool IsCurrent(uint32 generation) const;
+
+	// Stops the workers after their current task; queued tasks are dropped.
+	void Shutdown();
+
+private:
+	struct QueuedTask {
+		Task task;
+		uint32 generation;
+	};
+
+	void WorkerLoop();
+	bool NextTask(QueuedTask& next, Lane& lane);
+	void DropStaleLocked(std::deque<QueuedTask>& queue);
+
+	int32 fWorkerCount;
+	std::vector<std::thread> fWorkers;
+	std::mutex fLock;
+	std::condition_variable fCondition;
+	std::deque<QueuedTask> fInteractive;
+	std::deque<QueuedTask> fBackground;
+	int32 fRunningBackground;
+	bool fQuitting;
+	std::atomic<uint32> fGeneration;
+};
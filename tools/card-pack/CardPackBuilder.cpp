@@ -0,0 +1,269 @@
+// Converts the card images listed in CardResources.rdef into a card pack:
+// one file of decoded B_RGBA32 pixels at several sizes per card, read in
+// place by CardPack. See CardPackFormat.h for the layout.
+//
+// With --previews, writes tiny previews of every card instead, to be built
+// into the application as a resource; see CardPreviewFormat.h.
+//
+//	card-pack [--levels N] [--min-width PIXELS] CardResources.rdef cards.pack
+//	card-pack --previews WIDTH CardResources.rdef previews.bin
+
+#include "CardPackFormat.h"
+#include "CardPreviewFormat.h"
+#include "ImageScaler.h"
+
+#include <webp/decode.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+struct CardSource {
+	int32 resourceID;
+	std::string path;
+};
+
+
+static bool
+ReadFile(const std::string& path, std::vector<uint8>& data)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file)
+		return false;
+
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+
+// Picks the 'BBMP' resources out of lines like
+//	resource(1, "01_the_magician.webp") #'BBMP' import "cards/01_the_magician.webp";
+static bool
+ParseResources(const std::string& rdefPath, std::vector<CardSource>& cards)
+{
+	std::ifstream file(rdefPath.c_str());
+	if (!file)
+		return false;
+
+	// Imports are relative to the directory of the rdef file
+	std::string directory;
+	size_t slash = rdefPath.rfind('/');
+	if (slash != std::string::npos)
+		directory = rdefPath.substr(0, slash + 1);
+
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t resource = line.find("resource(");
+		size_t import = line.find("import \"");
+		if (resource == std::string::npos || import == std::string::npos
+			|| line.find("'BBMP'") == std::string::npos) {
+			continue;
+		}
+
+		size_t pathStart = import + strlen("import \"");
+		size_t pathEnd = line.find('"', pathStart);
+		if (pathEnd == std::string::npos)
+			continue;
+
+		CardSource card;
+		card.resourceID = strtol(line.c_str() + resource + strlen("resource("), NULL, 10);
+		card.path = directory + line.substr(pathStart, pathEnd - pathStart);
+		cards.push_back(card);
+	}
+	return true;
+}
+
+
+static uint64
+Align(uint64 offset)
+{
+	return (offset + kCardPackAlignment - 1) / kCardPackAlignment * kCardPackAlignment;
+}
+
+
+static int
+WritePreviews(const std::vector<CardSource>& cards, int32 previewWidth,
+	const std::string& path)
+{
+	std::vector<CardPreviewEntry> entries;
+	std::vector<uint8> pixels;
+	for (size_t i = 0; i < cards.size(); i++) {
+		std::vector<uint8> file;
+		int width;
+		int height;
+		uint8* decoded = NULL;
+		if (ReadFile(cards[i].path, file))
+			decoded = WebPDecodeBGRA(file.data(), file.size(), &width, &height);
+		if (decoded == NULL) {
+			std::cerr << "Cannot decode " << cards[i].path << std::endl;
+			return 1;
+		}
+
+		CardPreviewEntry entry = {};
+		entry.resourceID = cards[i].resourceID;
+		ImageScaler::FitSize(width, height, previewWidth, height, entry.width, entry.height);
+		entry.offset = pixels.size();
+		entries.push_back(entry);
+
+		pixels.resize(pixels.size() + static_cast<size_t>(entry.width) * entry.height * 4);
+		ImageScaler scaler(width, height, entry.width, entry.height);
+		scaler.Scale(decoded, width * 4, pixels.data() + entry.offset, entry.width * 4);
+		WebPFree(decoded);
+	}
+
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	CardPreviewsHeader header = {};
+	header.magic = kCardPreviewsMagic;
+	header.version = kCardPreviewsVersion;
+	header.entryCount = entries.size();
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(entries.data()),
+		entries.size() * sizeof(CardPreviewEntry));
+	out.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+	if (!out) {
+		std::cerr << "Cannot write " << path << std::endl;
+		return 1;
+	}
+
+	std::cout << "Wrote previews of " << cards.size() << " cards, "
+			  << (sizeof(header) + entries.size() * sizeof(CardPreviewEntry) + pixels.size())
+				/ 1024
+			  << " KB to " << path << std::endl;
+	return 0;
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int32 levelCount = 3;
+	int32 minWidth = 64;
+	int32 previewWidth = 0;
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--levels" && i + 1 < argc)
+			levelCount = atoi(argv[++i]);
+		else if (arg == "--min-width" && i + 1 < argc)
+			minWidth = atoi(argv[++i]);
+		else if (arg == "--previews" && i + 1 < argc)
+			previewWidth = atoi(argv[++i]);
+		else
+			paths.push_back(arg);
+	}
+
+	if (paths.size() != 2 || levelCount < 1 || previewWidth < 0) {
+		std::cerr << "usage: " << argv[0]
+				  << " [--levels N] [--min-width PIXELS] CardResources.rdef cards.pack\n"
+				  << "       " << argv[0] << " --previews WIDTH CardResources.rdef previews.bin"
+				  << std::endl;
+		return 1;
+	}
+
+	std::vector<CardSource> cards;
+	if (!ParseResources(paths[0], cards) || cards.empty()) {
+		std::cerr << "No card images found in " << paths[0] << std::endl;
+		return 1;
+	}
+
+	if (previewWidth > 0)
+		return WritePreviews(cards, previewWidth, paths[1]);
+
+	// Lay out the index first; only the image headers are needed for that
+	std::vector<CardPackEntry> entries;
+	std::vector<std::vector<uint8> > files(cards.size());
+	for (size_t i = 0; i < cards.size(); i++) {
+		int width;
+		int height;
+		if (!ReadFile(cards[i].path, files[i])
+			|| !WebPGetInfo(files[i].data(), files[i].size(), &width, &height)) {
+			std::cerr << "Cannot read " << cards[i].path << std::endl;
+			return 1;
+		}
+
+		for (int32 level = 0; level < levelCount; level++) {
+			CardPackEntry entry = {};
+			entry.resourceID = cards[i].resourceID;
+			entry.level = level;
+			if (level == 0) {
+				entry.width = width;
+				entry.height = height;
+			} else {
+				const CardPackEntry& previous = entries.back();
+				int32 levelWidth = (previous.width + 1) / 2;
+				if (levelWidth < minWidth)
+					break;
+				ImageScaler::FitSize(width, height, levelWidth, height, entry.width,
+					entry.height);
+			}
+			entry.bytesPerRow = entry.width * 4;
+			entries.push_back(entry);
+		}
+	}
+
+	uint64 offset = sizeof(CardPackHeader) + entries.size() * sizeof(CardPackEntry);
+	for (size_t i = 0; i < entries.size(); i++) {
+		offset = Align(offset);
+		entries[i].offset = offset;
+		offset += static_cast<uint64>(entries[i].bytesPerRow) * entries[i].height;
+	}
+
+	std::ofstream out(paths[1].c_str(), std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Cannot write " << paths[1] << std::endl;
+		return 1;
+	}
+
+	CardPackHeader header = {};
+	header.magic = kCardPackMagic;
+	header.version = kCardPackVersion;
+	header.entryCount = entries.size();
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(entries.data()),
+		entries.size() * sizeof(CardPackEntry));
+
+	size_t entry = 0;
+	for (size_t i = 0; i < cards.size(); i++) {
+		// B_RGBA32 is stored as B, G, R, A in memory
+		int width;
+		int height;
+		uint8* pixels = WebPDecodeBGRA(files[i].data(), files[i].size(), &width, &height);
+		if (pixels == NULL) {
+			std::cerr << "Cannot decode " << cards[i].path << std::endl;
+			return 1;
+		}
+
+		for (; entry < entries.size() && entries[entry].resourceID == cards[i].resourceID;
+			entry++) {
+			const CardPackEntry& level = entries[entry];
+			std::vector<uint8> scaled;
+			const uint8* data = pixels;
+			if (level.level > 0) {
+				scaled.resize(static_cast<size_t>(level.bytesPerRow) * level.height);
+				ImageScaler scaler(width, height, level.width, level.height);
+				scaler.Scale(pixels, width * 4, scaled.data(), level.bytesPerRow);
+				data = scaled.data();
+			}
+
+			std::vector<char> padding(level.offset - out.tellp(), 0);
+			out.write(padding.data(), padding.size());
+			out.write(reinterpret_cast<const char*>(data),
+				static_cast<size_t>(level.bytesPerRow) * level.height);
+		}
+		WebPFree(pixels);
+	}
+
+	if (!out) {
+		std::cerr << "Cannot write " << paths[1] << std::endl;
+		return 1;
+	}
+
+	std::cout << "Wrote " << cards.size() << " cards, " << entries.size() << " images, "
+			  << offset / (1024 * 1024) << " MB to " << paths[1] << std::endl;
+	return 0;
+}
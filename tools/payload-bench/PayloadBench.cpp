@@ -0,0 +1,99 @@
+// Compares building request payloads through a JSON document, as
+// JSONParser::BuildPayload does, with rendering a PayloadTemplate. Both paths
+// must produce the same bytes, which is checked before anything is timed.
+
+#include "JSONParser.h"
+#include "PayloadTemplate.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+
+static const int kMaxTokens = 300;
+static const float kTemperature = 0.7f;
+
+
+static std::vector<BString>
+MakePrompts()
+{
+	std::vector<BString> prompts;
+
+	BString threeCard = "Provide a tarot card reading for the following three cards drawn in a "
+						"simple spread: \n- The Tower\n- Three of Cups\n- Knight of Wands";
+	threeCard << ". Give a detailed, insightful reading focusing on the combined meaning of "
+				 "these cards. Keep the response to 5-7 sentences.";
+	prompts.push_back(threeCard);
+
+	BString treeOfLife = "Provide a tarot card reading for the following ten cards drawn in a "
+						 "Tree of Life spread: ";
+	for (int i = 1; i <= 10; i++)
+		treeOfLife << "\n- " << i << ". Sephirah \"" << i << "\" - Position: Ace of Wands";
+	prompts.push_back(treeOfLife);
+
+	// Everything the escaper has to get right
+	prompts.push_back("Quotes \" and \\ backslashes, tabs\t, \x01\x1f control bytes, "
+					  "\b\f\r\n, a slash / and UTF-8: K\xc3\xb6nig der Kelche \xe2\x80\x94 ok");
+	prompts.push_back("");
+
+	return prompts;
+}
+
+
+template<typename Build>
+static double
+NanosecondsPerPayload(const std::vector<BString>& prompts, int iterations, Build build)
+{
+	size_t totalLength = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		for (size_t p = 0; p < prompts.size(); p++)
+			totalLength += build(prompts[p]).Length();
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	// Keeps the compiler from dropping the loop
+	if (totalLength == 0)
+		std::cout << "";
+
+	return std::chrono::duration<double, std::nano>(elapsed).count()
+		/ (static_cast<double>(iterations) * prompts.size());
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	std::vector<BString> prompts = MakePrompts();
+
+	for (int stream = 0; stream < 2; stream++) {
+		PayloadTemplate payloadTemplate(kMaxTokens, kTemperature, stream != 0);
+		for (size_t p = 0; p < prompts.size(); p++) {
+			BString expected = JSONParser::BuildPayload(prompts[p], kMaxTokens, kTemperature,
+				stream != 0);
+			BString rendered = payloadTemplate.Render(prompts[p]);
+			if (rendered != expected) {
+				std::cerr << "Mismatch for prompt " << p << ":\n  " << expected.String()
+						  << "\n  " << rendered.String() << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	PayloadTemplate payloadTemplate(kMaxTokens, kTemperature, false);
+	double domTime = NanosecondsPerPayload(prompts, iterations, [](const BString& prompt) {
+		return JSONParser::BuildPayload(prompt, kMaxTokens, kTemperature);
+	});
+	double templateTime
+		= NanosecondsPerPayload(prompts, iterations, [&](const BString& prompt) {
+			  return payloadTemplate.Render(prompt);
+		  });
+
+	std::cout << "Payloads are identical for " << prompts.size() << " prompts" << std::endl;
+	std::cout << "BuildPayload:    " << domTime << " ns per payload" << std::endl;
+	std::cout << "PayloadTemplate: " << templateTime << " ns per payload ("
+			  << domTime / templateTime << "x)" << std::endl;
+	return 0;
+}
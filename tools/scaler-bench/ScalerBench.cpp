@@ -0,0 +1,163 @@
+// Times every image scaler kernel this machine supports and checks that
+// each one gives the same pixels as the scalar reference.
+//
+//	scaler-bench [--runs N] [SOURCE_WIDTH SOURCE_HEIGHT]
+
+#include "ImageScaler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+
+struct Size {
+	int32 width;
+	int32 height;
+};
+
+
+// Card art is mostly smooth with some fine line work; a mix of gradients and
+// pseudo-random noise covers both
+static void
+FillSource(std::vector<uint8>& pixels, int32 width, int32 height)
+{
+	uint32 seed = 12345;
+	for (int32 y = 0; y < height; y++) {
+		for (int32 x = 0; x < width; x++) {
+			seed = seed * 1103515245 + 12345;
+			uint8* pixel = &pixels[(static_cast<size_t>(y) * width + x) * 4];
+			pixel[0] = static_cast<uint8>(x * 255 / std::max<int32>(1, width - 1));
+			pixel[1] = static_cast<uint8>(y * 255 / std::max<int32>(1, height - 1));
+			pixel[2] = static_cast<uint8>(seed >> 24);
+			pixel[3] = (x / 8 + y / 8) % 2 == 0 ? 255 : 128;
+		}
+	}
+}
+
+
+static void
+Compare(const std::vector<uint8>& reference, const std::vector<uint8>& result,
+	int32& maxDifference, double& psnr)
+{
+	maxDifference = 0;
+	double squares = 0;
+	for (size_t i = 0; i < reference.size(); i++) {
+		int32 difference = abs(static_cast<int32>(reference[i]) - result[i]);
+		maxDifference = std::max(maxDifference, difference);
+		squares += static_cast<double>(difference) * difference;
+	}
+
+	if (squares == 0) {
+		psnr = INFINITY;
+		return;
+	}
+	double mse = squares / reference.size();
+	psnr = 10 * log10(255.0 * 255.0 / mse);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int32 runs = 20;
+	Size source = {554, 960};
+	std::vector<int32> numbers;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = atoi(argv[++i]);
+		else
+			numbers.push_back(atoi(argv[i]));
+	}
+
+	if ((numbers.size() != 0 && numbers.size() != 2) || runs < 1) {
+		fprintf(stderr, "usage: %s [--runs N] [SOURCE_WIDTH SOURCE_HEIGHT]\n", argv[0]);
+		return 1;
+	}
+	if (numbers.size() == 2) {
+		source.width = numbers[0];
+		source.height = numbers[1];
+	}
+	if (source.width < 1 || source.height < 1) {
+		fprintf(stderr, "Invalid source size\n");
+		return 1;
+	}
+
+	std::vector<uint8> pixels(static_cast<size_t>(source.width) * source.height * 4);
+	FillSource(pixels, source.width, source.height);
+
+	// Card sizes from a three card reading down to roughly the cards of the
+	// ten card Tree of Life spread, plus one enlargement
+	const int32 kFactors[] = {100, 50, 33, 21, 150};
+	const ImageScaler::Kernel kKernels[] = {
+		ImageScaler::kScalarKernel,
+		ImageScaler::kSSE2Kernel,
+		ImageScaler::kAVX2Kernel
+	};
+
+	printf("Source %dx%d, %d runs, best kernel %s\n", source.width, source.height, runs,
+		ImageScaler::KernelName(ImageScaler::BestKernel()));
+	printf("%-10s %-8s %10s %8s %9s %8s\n", "target", "kernel", "ms/image", "speedup",
+		"max diff", "PSNR");
+
+	bool identical = true;
+	for (int32 factor : kFactors) {
+		Size target;
+		ImageScaler::FitSize(source.width, source.height, source.width * factor / 100,
+			source.height * factor / 100, target.width, target.height);
+		if (factor == 100) {
+			// Not a plain copy: the common card size on a wide window
+			ImageScaler::FitSize(source.width, source.height, 320, 560, target.width,
+				target.height);
+		}
+
+		std::vector<uint8> reference;
+		double scalarTime = 0;
+		for (ImageScaler::Kernel kernel : kKernels) {
+			if (!ImageScaler::IsSupported(kernel))
+				continue;
+
+			ImageScaler scaler(source.width, source.height, target.width, target.height);
+			scaler.SetKernel(kernel);
+			std::vector<uint8> result(static_cast<size_t>(target.width) * target.height * 4);
+
+			// The first run warms up caches and is not counted
+			scaler.Scale(pixels.data(), source.width * 4, result.data(), target.width * 4);
+			auto start = std::chrono::steady_clock::now();
+			for (int32 run = 0; run < runs; run++) {
+				scaler.Scale(pixels.data(), source.width * 4, result.data(),
+					target.width * 4);
+			}
+			std::chrono::duration<double, std::milli> elapsed
+				= std::chrono::steady_clock::now() - start;
+			double time = elapsed.count() / runs;
+
+			if (kernel == ImageScaler::kScalarKernel) {
+				reference = result;
+				scalarTime = time;
+			}
+
+			int32 maxDifference;
+			double psnr;
+			Compare(reference, result, maxDifference, psnr);
+			if (maxDifference != 0)
+				identical = false;
+
+			char size[32];
+			snprintf(size, sizeof(size), "%dx%d", target.width, target.height);
+			printf("%-10s %-8s %10.3f %7.2fx %9d %8.1f\n", size,
+				ImageScaler::KernelName(kernel), time, scalarTime / time, maxDifference,
+				psnr);
+		}
+	}
+
+	if (!identical) {
+		printf("Kernels differ from the scalar reference\n");
+		return 1;
+	}
+	return 0;
+}
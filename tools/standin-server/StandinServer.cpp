@@ -0,0 +1,604 @@
+// A stand-in for an OpenAI-compatible chat completions endpoint. It replays
+// canned readings, either as one JSON response or as a server-sent event
+// stream, and can add latency, jitter, slow-drip bodies and failures so that
+// the reading pipeline can be measured and exercised without the real service.
+//
+// Point the application at it with
+//	ACE_OF_WANDS_API_ENDPOINT=http://localhost:8080/v1/chat/completions
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+
+struct ServerOptions {
+	ServerOptions()
+		:
+		address("127.0.0.1"),
+		port(8080),
+		path("/v1/chat/completions"),
+		latency(0),
+		jitter(0),
+		drip(0),
+		chunkBytes(64),
+		errorRate(0.0),
+		errorStatus(500),
+		resetRate(0.0),
+		seed(std::random_device()()),
+		quiet(false)
+	{
+	}
+
+	std::string address;
+	unsigned short port;
+	std::string path;
+	std::string responseDirectory;
+	int latency; // Milliseconds before the response headers are sent
+	int jitter; // Up to this many milliseconds added to or taken from latency
+	int drip; // Milliseconds between two body chunks or two events
+	int chunkBytes; // Size of the body chunks of a dripped JSON response
+	double errorRate; // Share of requests answered with errorStatus
+	int errorStatus;
+	double resetRate; // Share of responses cut off halfway through the body
+	unsigned seed;
+	bool quiet;
+};
+
+
+class StandinServer {
+public:
+	StandinServer(const ServerOptions& options);
+
+	bool LoadResponses();
+	int Run();
+
+private:
+	enum Fault { kNoFault, kErrorFault, kResetFault };
+
+	void Serve(tcp::socket socket);
+	bool Respond(tcp::socket& socket, const http::request<http::string_body>& request);
+	bool SendError(tcp::socket& socket, unsigned version, bool keepAlive, http::status status,
+		const std::string& message);
+	bool SendCompletion(tcp::socket& socket, unsigned version, bool keepAlive,
+		const std::string& text, bool reset);
+	bool SendEventStream(tcp::socket& socket, unsigned version, bool keepAlive,
+		const std::string& text, bool reset);
+
+	std::string NextResponse();
+	int NextDelay();
+	Fault NextFault();
+	void Drip() const;
+
+	static bool WantsStream(const std::string& body);
+	static std::vector<std::string> SplitIntoDeltas(const std::string& text);
+	static std::string EscapeJSON(const std::string& text);
+	std::string CompletionId();
+
+	ServerOptions fOptions;
+	std::vector<std::string> fResponses;
+	std::atomic<size_t> fNextResponse;
+	std::atomic<unsigned long> fRequestCount;
+
+	std::mutex fRandomLock;
+	std::mt19937 fRandom;
+};
+
+
+static const char* kDefaultResponses[] = {
+	"The cards speak of a threshold you are already standing on. What began as a spark of "
+	"intention has gathered enough strength to be acted upon, and the middle card asks for "
+	"patience rather than force. Old attachments loosen their hold as you give them less "
+	"attention. The final card promises steady growth if you keep tending what you started. "
+	"Trust the slow work; it is the kind that lasts.",
+
+	"This spread balances ambition with reflection. The first card points to a season of "
+	"effort that has left you tired but wiser, while the second shows a choice that cannot be "
+	"postponed much longer. Together they suggest that clarity will come from acting, not "
+	"from waiting for certainty. The last card softens the picture with support from someone "
+	"close. Lean on it without apology.",
+
+	"A quiet change runs underneath these cards. Something you considered settled is asking "
+	"to be looked at again, and the reversal at the centre hints that resistance costs more "
+	"than the change itself. Creativity is your ally here, as is a willingness to be a "
+	"beginner once more. The outcome card is bright and open. Let the new shape reveal itself "
+	"before you name it."
+};
+
+
+StandinServer::StandinServer(const ServerOptions& options)
+	:
+	fOptions(options),
+	fNextResponse(0),
+	fRequestCount(0),
+	fRandom(options.seed)
+{
+}
+
+
+bool
+StandinServer::LoadResponses()
+{
+	if (fOptions.responseDirectory.empty()) {
+		for (const char* response : kDefaultResponses)
+			fResponses.push_back(response);
+		return true;
+	}
+
+	// Every file in the directory holds the text of one reading; they are
+	// replayed in name order
+	DIR* directory = opendir(fOptions.responseDirectory.c_str());
+	if (directory == NULL) {
+		std::cerr << "Cannot open " << fOptions.responseDirectory << ": " << strerror(errno)
+				  << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> names;
+	while (struct dirent* entry = readdir(directory)) {
+		if (entry->d_name[0] != '.')
+			names.push_back(entry->d_name);
+	}
+	closedir(directory);
+	std::sort(names.begin(), names.end());
+
+	for (const std::string& name : names) {
+		std::ifstream file(fOptions.responseDirectory + "/" + name, std::ios::binary);
+		std::stringstream contents;
+		contents << file.rdbuf();
+		if (!contents.str().empty())
+			fResponses.push_back(contents.str());
+	}
+
+	if (fResponses.empty()) {
+		std::cerr << "No responses found in " << fOptions.responseDirectory << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+int
+StandinServer::Run()
+{
+	net::io_context ioContext;
+	beast::error_code ec;
+	tcp::endpoint endpoint(net::ip::make_address(fOptions.address, ec), fOptions.port);
+	if (ec) {
+		std::cerr << "Invalid address " << fOptions.address << ": " << ec.message() << std::endl;
+		return 1;
+	}
+
+	tcp::acceptor acceptor(ioContext);
+	acceptor.open(endpoint.protocol(), ec);
+	if (!ec)
+		acceptor.set_option(net::socket_base::reuse_address(true), ec);
+	if (!ec)
+		acceptor.bind(endpoint, ec);
+	if (!ec)
+		acceptor.listen(net::socket_base::max_listen_connections, ec);
+	if (ec) {
+		std::cerr << "Cannot listen on " << fOptions.address << ":" << fOptions.port << ": "
+				  << ec.message() << std::endl;
+		return 1;
+	}
+
+	std::cout << "Serving " << fResponses.size() << " canned responses on http://"
+			  << fOptions.address << ":" << acceptor.local_endpoint().port() << fOptions.path
+			  << std::endl;
+
+	// One thread per connection keeps slow-drip responses from holding up
+	// everybody else, which is what a load test needs to see.
+	while (true) {
+		tcp::socket socket(ioContext);
+		acceptor.accept(socket, ec);
+		if (ec) {
+			std::cerr << "Accept failed: " << ec.message() << std::endl;
+			continue;
+		}
+		std::thread(&StandinServer::Serve, this, std::move(socket)).detach();
+	}
+}
+
+
+void
+StandinServer::Serve(tcp::socket socket)
+{
+	beast::error_code ec;
+	socket.set_option(tcp::no_delay(true), ec);
+
+	beast::flat_buffer buffer;
+	while (true) {
+		http::request<http::string_body> request;
+		http::read(socket, buffer, request, ec);
+		if (ec)
+			break;
+
+		if (!Respond(socket, request) || !request.keep_alive())
+			break;
+	}
+
+	socket.shutdown(tcp::socket::shutdown_send, ec);
+}
+
+
+bool
+StandinServer::Respond(tcp::socket& socket, const http::request<http::string_body>& request)
+{
+	unsigned long number = ++fRequestCount;
+	unsigned version = request.version();
+	bool keepAlive = request.keep_alive();
+	bool stream = WantsStream(request.body());
+	auto started = std::chrono::steady_clock::now();
+
+	int delay = NextDelay();
+	if (delay > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+	Fault fault = NextFault();
+	const char* outcome = "ok";
+	bool result;
+	if (request.method() != http::verb::post || request.target() != fOptions.path) {
+		outcome = "not found";
+		result = SendError(socket, version, keepAlive, http::status::not_found,
+			"Unknown endpoint");
+	} else if (!request[http::field::authorization].starts_with("Bearer ")) {
+		outcome = "unauthorized";
+		result = SendError(socket, version, keepAlive, http::status::unauthorized,
+			"Missing API key");
+	} else if (fault == kErrorFault) {
+		outcome = "injected error";
+		result = SendError(socket, version, keepAlive,
+			static_cast<http::status>(fOptions.errorStatus), "Injected failure");
+	} else {
+		if (fault == kResetFault)
+			outcome = "injected reset";
+		std::string text = NextResponse();
+		if (stream)
+			result = SendEventStream(socket, version, keepAlive, text, fault == kResetFault);
+		else
+			result = SendCompletion(socket, version, keepAlive, text, fault == kResetFault);
+	}
+
+	if (!fOptions.quiet) {
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - started);
+		std::cout << "#" << number << " " << (stream ? "stream" : "json") << " " << outcome
+				  << " in " << elapsed.count() << " ms" << std::endl;
+	}
+
+	return result;
+}
+
+
+bool
+StandinServer::SendError(tcp::socket& socket, unsigned version, bool keepAlive,
+	http::status status, const std::string& message)
+{
+	http::response<http::string_body> response(status, version);
+	response.set(http::field::server, "standin-server");
+	response.set(http::field::content_type, "application/json");
+	response.keep_alive(keepAlive);
+	response.body() = "{\"error\":{\"message\":\"" + EscapeJSON(message)
+		+ "\",\"type\":\"standin_error\"}}";
+	response.prepare_payload();
+
+	beast::error_code ec;
+	http::write(socket, response, ec);
+	return !ec;
+}
+
+
+bool
+StandinServer::SendCompletion(tcp::socket& socket, unsigned version, bool keepAlive,
+	const std::string& text, bool reset)
+{
+	std::string body = "{\"id\":\"" + CompletionId()
+		+ "\",\"object\":\"chat.completion\",\"created\":" + std::to_string(time(NULL))
+		+ ",\"model\":\"standin-chat\",\"choices\":[{\"index\":0,\"message\":{\"role\":"
+		  "\"assistant\",\"content\":\""
+		+ EscapeJSON(text)
+		+ "\"},\"finish_reason\":\"stop\"}],\"usage\":{\"prompt_tokens\":0,"
+		  "\"completion_tokens\":0,\"total_tokens\":0}}";
+
+	http::response<http::empty_body> response(http::status::ok, version);
+	response.set(http::field::server, "standin-server");
+	response.set(http::field::content_type, "application/json");
+	response.keep_alive(keepAlive);
+	response.content_length(body.size());
+
+	beast::error_code ec;
+	http::response_serializer<http::empty_body> serializer(response);
+	http::write_header(socket, serializer, ec);
+	if (ec)
+		return false;
+
+	// Without a drip the body goes out in one piece
+	size_t chunkBytes = fOptions.drip > 0 ? static_cast<size_t>(fOptions.chunkBytes) : body.size();
+	size_t cutOff = reset ? body.size() / 2 : body.size();
+	for (size_t offset = 0; offset < cutOff; offset += chunkBytes) {
+		if (offset > 0)
+			Drip();
+		size_t length = std::min(chunkBytes, cutOff - offset);
+		net::write(socket, net::buffer(body.data() + offset, length), ec);
+		if (ec)
+			return false;
+	}
+
+	if (reset) {
+		socket.close(ec);
+		return false;
+	}
+
+	return true;
+}
+
+
+bool
+StandinServer::SendEventStream(tcp::socket& socket, unsigned version, bool keepAlive,
+	const std::string& text, bool reset)
+{
+	http::response<http::empty_body> response(http::status::ok, version);
+	response.set(http::field::server, "standin-server");
+	response.set(http::field::content_type, "text/event-stream");
+	response.set(http::field::cache_control, "no-cache");
+	response.keep_alive(keepAlive);
+	response.chunked(true);
+
+	beast::error_code ec;
+	http::response_serializer<http::empty_body> serializer(response);
+	http::write_header(socket, serializer, ec);
+	if (ec)
+		return false;
+
+	std::string id = CompletionId();
+	std::string prefix = "data: {\"id\":\"" + id
+		+ "\",\"object\":\"chat.completion.chunk\",\"created\":" + std::to_string(time(NULL))
+		+ ",\"model\":\"standin-chat\",\"choices\":[{\"index\":0,";
+
+	std::vector<std::string> events;
+	events.push_back(
+		prefix + "\"delta\":{\"role\":\"assistant\",\"content\":\"\"},\"finish_reason\":null}]}\n\n");
+	std::vector<std::string> deltas = SplitIntoDeltas(text);
+	for (const std::string& delta : deltas) {
+		events.push_back(prefix + "\"delta\":{\"content\":\"" + EscapeJSON(delta)
+			+ "\"},\"finish_reason\":null}]}\n\n");
+	}
+	events.push_back(prefix + "\"delta\":{},\"finish_reason\":\"stop\"}]}\n\n");
+	events.push_back("data: [DONE]\n\n");
+
+	size_t cutOff = reset ? events.size() / 2 : events.size();
+	for (size_t i = 0; i < cutOff; i++) {
+		if (i > 0)
+			Drip();
+		net::write(socket, http::make_chunk(net::buffer(events[i])), ec);
+		if (ec)
+			return false;
+	}
+
+	if (reset) {
+		socket.close(ec);
+		return false;
+	}
+
+	net::write(socket, http::make_chunk_last(), ec);
+	return !ec;
+}
+
+
+std::string
+StandinServer::NextResponse()
+{
+	return fResponses[fNextResponse++ % fResponses.size()];
+}
+
+
+int
+StandinServer::NextDelay()
+{
+	int delay = fOptions.latency;
+	if (fOptions.jitter > 0) {
+		std::lock_guard<std::mutex> lock(fRandomLock);
+		std::uniform_int_distribution<int> distribution(-fOptions.jitter, fOptions.jitter);
+		delay += distribution(fRandom);
+	}
+	return delay < 0 ? 0 : delay;
+}
+
+
+StandinServer::Fault
+StandinServer::NextFault()
+{
+	std::lock_guard<std::mutex> lock(fRandomLock);
+	std::uniform_real_distribution<double> distribution(0.0, 1.0);
+	double roll = distribution(fRandom);
+	if (roll < fOptions.errorRate)
+		return kErrorFault;
+	if (roll < fOptions.errorRate + fOptions.resetRate)
+		return kResetFault;
+	return kNoFault;
+}
+
+
+void
+StandinServer::Drip() const
+{
+	if (fOptions.drip > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(fOptions.drip));
+}
+
+
+bool
+StandinServer::WantsStream(const std::string& body)
+{
+	// Good enough for the payloads the application sends; no JSON parser needed
+	size_t key = body.find("\"stream\"");
+	if (key == std::string::npos)
+		return false;
+
+	size_t value = body.find_first_not_of(" \t\r\n:", key + 8);
+	return value != std::string::npos && body.compare(value, 4, "true") == 0;
+}
+
+
+std::vector<std::string>
+StandinServer::SplitIntoDeltas(const std::string& text)
+{
+	// Roughly one token per event: each word together with the space after it
+	std::vector<std::string> deltas;
+	size_t start = 0;
+	while (start < text.size()) {
+		size_t end = text.find_first_of(" \n", start);
+		end = end == std::string::npos ? text.size() : end + 1;
+		deltas.push_back(text.substr(start, end - start));
+		start = end;
+	}
+	return deltas;
+}
+
+
+std::string
+StandinServer::EscapeJSON(const std::string& text)
+{
+	std::string escaped;
+	escaped.reserve(text.size() + 16);
+	for (unsigned char c : text) {
+		switch (c) {
+			case '"':
+				escaped += "\\\"";
+				break;
+			case '\\':
+				escaped += "\\\\";
+				break;
+			case '\n':
+				escaped += "\\n";
+				break;
+			case '\r':
+				escaped += "\\r";
+				break;
+			case '\t':
+				escaped += "\\t";
+				break;
+			default:
+				if (c < 0x20) {
+					char code[8];
+					snprintf(code, sizeof(code), "\\u%04x", c);
+					escaped += code;
+				} else {
+					escaped += static_cast<char>(c);
+				}
+				break;
+		}
+	}
+	return escaped;
+}
+
+
+std::string
+StandinServer::CompletionId()
+{
+	return "standin-" + std::to_string(fRequestCount.load());
+}
+
+
+static void
+PrintUsage(const char* name)
+{
+	std::cout
+		<< "Usage: " << name << " [options]\n"
+		<< "  --address ADDR       address to listen on (127.0.0.1)\n"
+		<< "  --port N             port to listen on, 0 picks a free one (8080)\n"
+		<< "  --path PATH          endpoint path (/v1/chat/completions)\n"
+		<< "  --responses DIR      replay the files in DIR instead of the built-in readings\n"
+		<< "  --latency MS         delay before the response headers (0)\n"
+		<< "  --jitter MS          random +/- variation of the latency (0)\n"
+		<< "  --drip MS            delay between stream events or body chunks (0)\n"
+		<< "  --chunk-bytes N      body chunk size of dripped JSON responses (64)\n"
+		<< "  --error-rate P       share of requests answered with an error (0)\n"
+		<< "  --error-status CODE  HTTP status of injected errors (500)\n"
+		<< "  --reset-rate P       share of responses cut off halfway (0)\n"
+		<< "  --seed N             seed for jitter and fault injection\n"
+		<< "  --quiet              do not log every request\n";
+}
+
+
+int
+main(int argc, char** argv)
+{
+	ServerOptions options;
+	for (int i = 1; i < argc; i++) {
+		std::string option = argv[i];
+		if (option == "--help" || option == "-h") {
+			PrintUsage(argv[0]);
+			return 0;
+		}
+		if (option == "--quiet") {
+			options.quiet = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+
+		const char* value = argv[++i];
+		if (option == "--address")
+			options.address = value;
+		else if (option == "--port")
+			options.port = static_cast<unsigned short>(atoi(value));
+		else if (option == "--path")
+			options.path = value;
+		else if (option == "--responses")
+			options.responseDirectory = value;
+		else if (option == "--latency")
+			options.latency = atoi(value);
+		else if (option == "--jitter")
+			options.jitter = atoi(value);
+		else if (option == "--drip")
+			options.drip = atoi(value);
+		else if (option == "--chunk-bytes")
+			options.chunkBytes = std::max(1, atoi(value));
+		else if (option == "--error-rate")
+			options.errorRate = atof(value);
+		else if (option == "--error-status")
+			options.errorStatus = atoi(value);
+		else if (option == "--reset-rate")
+			options.resetRate = atof(value);
+		else if (option == "--seed")
+			options.seed = static_cast<unsigned>(strtoul(value, NULL, 10));
+		else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	// A client that goes away mid-drip must not take the server with it
+	signal(SIGPIPE, SIG_IGN);
+
+	StandinServer server(options);
+	if (!server.LoadResponses())
+		return 1;
+
+	return server.Run();
+}